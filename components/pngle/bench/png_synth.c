@@ -0,0 +1,704 @@
+/*
+ * PNG corpus synthesizer for the host benchmark; see png_synth.h.
+ *
+ * The encoder is deliberately independent from pngle/miniz: it uses the system zlib for
+ * deflate and CRC, and the expected pixels are derived from the samples by the PNG spec rules,
+ * so a decoder bug can't cancel itself out.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <zlib.h>
+
+#include "png_synth.h"
+
+typedef enum {
+	PATTERN_NOISE,    // uniformly random samples; worst case for the filters and inflate
+	PATTERN_GRADIENT, // smooth ramps; long matches
+	PATTERN_ART,      // procedural album art; what the display actually receives
+} synth_pattern_t;
+
+typedef enum {
+	FILTER_RANDOM,   // a random filter type per row, to exercise every unfilter path
+	FILTER_ADAPTIVE, // minimum sum of absolute differences, as libpng does
+} synth_filter_t;
+
+typedef struct {
+	uint32_t w;
+	uint32_t h;
+	uint8_t color_type;
+	uint8_t depth;
+	uint8_t interlace;
+	synth_pattern_t pattern;
+	synth_filter_t filter;
+	uint16_t plte_n; // palette entries for color type 3; 0 selects 1 << depth
+	uint16_t trns_n; // color type 3: alpha entries; 0 / 2: non-zero enables a color key
+	uint8_t wbits;   // LZ77 window, 9 - 15
+	int8_t level;    // deflate level, 0 emits stored blocks
+	uint32_t idat_split; // maximum IDAT chunk size, 0 for a single chunk
+	const char *tag; // name suffix
+} synth_spec_t;
+
+typedef struct {
+	uint8_t *data;
+	size_t len;
+	size_t cap;
+} buf_t;
+
+static const uint8_t channels_of[7] = { 1, 0, 3, 1, 2, 0, 4 };
+
+static const uint32_t adam7[7][4] = { // x0, y0, dx, dy
+	{ 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 },
+};
+
+static uint32_t rng_state;
+
+static uint32_t rng(void)
+{
+	// xorshift32
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+static uint32_t hash2(uint32_t x, uint32_t y)
+{
+	uint32_t h = x * 0x9e3779b1u ^ (y + 0x7f4a7c15u) * 0x85ebca6bu;
+	h ^= h >> 15;
+	h *= 0x2c1b3c6du;
+	h ^= h >> 12;
+	return h;
+}
+
+static int buf_put(buf_t *b, const void *p, size_t n)
+{
+	if (b->len + n > b->cap) {
+		size_t cap = b->cap ? b->cap : 256;
+		while (cap < b->len + n) cap *= 2;
+		uint8_t *data = realloc(b->data, cap);
+		if (!data) return -1;
+		b->data = data;
+		b->cap = cap;
+	}
+	memcpy(b->data + b->len, p, n);
+	b->len += n;
+	return 0;
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static int put_chunk(buf_t *b, const char *type, const uint8_t *data, size_t len)
+{
+	uint8_t hdr[8];
+	put_be32(hdr, (uint32_t)len);
+	memcpy(hdr + 4, type, 4);
+
+	uLong crc = crc32(0, (const Bytef *)type, 4);
+	if (len) crc = crc32(crc, data, (uInt)len);
+
+	uint8_t tail[4];
+	put_be32(tail, (uint32_t)crc);
+
+	if (buf_put(b, hdr, 8) < 0) return -1;
+	if (len && buf_put(b, data, len) < 0) return -1;
+	return buf_put(b, tail, 4);
+}
+
+// Procedural album art: two-color diagonal gradient, a radial highlight, a few soft discs and grain
+static void art_pixel(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t seed, uint8_t rgba[4])
+{
+	static const float palette[4][3] = {
+		{ 0.85f, 0.25f, 0.20f }, { 0.10f, 0.20f, 0.45f }, { 0.95f, 0.75f, 0.30f }, { 0.20f, 0.55f, 0.50f },
+	};
+	float u = w > 1 ? (float)x / (w - 1) : 0.5f;
+	float v = h > 1 ? (float)y / (h - 1) : 0.5f;
+	const float *a = palette[seed % 4];
+	const float *b = palette[(seed + 1) % 4];
+	const float *c = palette[(seed + 2) % 4];
+
+	float t = (u + v) * 0.5f;
+	float col[3];
+	for (int i = 0; i < 3; i++) col[i] = a[i] * (1 - t) + b[i] * t;
+
+	float hx = u - 0.3f, hy = v - 0.25f;
+	float highlight = expf(-(hx * hx + hy * hy) * 8.0f) * 0.35f;
+	for (int i = 0; i < 3; i++) col[i] += highlight;
+
+	for (int k = 0; k < 3; k++) {
+		float cx = 0.25f + 0.25f * k, cy = 0.7f - 0.2f * k, r = 0.12f + 0.05f * k;
+		float d = sqrtf((u - cx) * (u - cx) + (v - cy) * (v - cy));
+		float m = fminf(fmaxf((r - d) * 40.0f, 0.0f), 1.0f); // anti-aliased edge
+		for (int i = 0; i < 3; i++) col[i] = col[i] * (1 - m * 0.8f) + c[i] * m * 0.8f;
+	}
+
+	int grain = (int)(hash2(x, y + seed * 4096) % 9) - 4;
+	for (int i = 0; i < 3; i++) {
+		int s = (int)(fminf(fmaxf(col[i], 0.0f), 1.0f) * 255.0f + 0.5f) + grain;
+		rgba[i] = s < 0 ? 0 : s > 255 ? 255 : s;
+	}
+
+	float vx = u - 0.5f, vy = v - 0.5f;
+	rgba[3] = 255 - (uint8_t)fminf((vx * vx + vy * vy) * 2.0f * 127.0f, 127.0f); // vignette
+}
+
+// 6x7x6 color cube used to index the art
+static uint16_t art_palette_index(const uint8_t rgba[4])
+{
+	uint16_t r = (rgba[0] * 5 + 127) / 255;
+	uint16_t g = (rgba[1] * 6 + 127) / 255;
+	uint16_t b = (rgba[2] * 5 + 127) / 255;
+	return (r * 7 + g) * 6 + b;
+}
+
+static uint16_t scale_from_8(uint8_t v, uint16_t maxval)
+{
+	return (uint16_t)((v * maxval + 127) / 255);
+}
+
+static uint8_t scale_to_8(uint16_t v, uint16_t maxval)
+{
+	return (uint8_t)((v * 255 + maxval / 2) / maxval);
+}
+
+static void make_samples(const synth_spec_t *s, uint32_t seed, uint16_t *samples, uint16_t plte_n)
+{
+	uint8_t ch = channels_of[s->color_type];
+	uint16_t maxval = s->color_type == 3 ? plte_n - 1 : (uint16_t)((1U << s->depth) - 1);
+
+	for (uint32_t y = 0; y < s->h; y++) {
+		for (uint32_t x = 0; x < s->w; x++) {
+			uint16_t *px = samples + ((size_t)y * s->w + x) * ch;
+
+			switch (s->pattern) {
+			case PATTERN_NOISE:
+				for (int c = 0; c < ch; c++) px[c] = rng() % (maxval + 1UL);
+				break;
+
+			case PATTERN_GRADIENT:
+				for (int c = 0; c < ch; c++) {
+					uint32_t ramp = (x * 7 + y * 3 + c * 50) % 256;
+					px[c] = s->depth < 8 || s->color_type == 3 ? ramp % (maxval + 1UL) : (uint16_t)(ramp * maxval / 255);
+				}
+				break;
+
+			case PATTERN_ART: {
+				uint8_t rgba[4];
+				art_pixel(x, y, s->w, s->h, seed, rgba);
+				uint8_t gray = (rgba[0] * 77 + rgba[1] * 150 + rgba[2] * 29) >> 8;
+
+				switch (s->color_type) {
+				case 0: px[0] = scale_from_8(gray, maxval); break;
+				case 2: for (int c = 0; c < 3; c++) px[c] = scale_from_8(rgba[c], maxval); break;
+				case 3: px[0] = art_palette_index(rgba); break;
+				case 4: px[0] = scale_from_8(gray, maxval); px[1] = scale_from_8(rgba[3], maxval); break;
+				case 6: for (int c = 0; c < 4; c++) px[c] = scale_from_8(rgba[c], maxval); break;
+				}
+				break;
+			}
+			}
+		}
+	}
+}
+
+// Expected RGBA8888 per the PNG spec: samples scaled to 8 bits, palette lookup, tRNS alpha
+static void make_expected(const synth_spec_t *s, const uint16_t *samples, const uint8_t *plte, const uint8_t *trns, uint16_t trns_n, uint8_t *rgba)
+{
+	uint8_t ch = channels_of[s->color_type];
+	uint16_t maxval = (1UL << s->depth) - 1;
+
+	for (size_t i = 0; i < (size_t)s->w * s->h; i++, samples += ch, rgba += 4) {
+		switch (s->color_type) {
+		case 3:
+			memcpy(rgba, plte + samples[0] * 3, 3);
+			rgba[3] = samples[0] < trns_n ? trns[samples[0]] : 255;
+			break;
+
+		case 0:
+		case 4:
+			rgba[0] = rgba[1] = rgba[2] = scale_to_8(samples[0], maxval);
+			if (s->color_type == 4) {
+				rgba[3] = scale_to_8(samples[1], maxval);
+			} else {
+				rgba[3] = trns_n && samples[0] == (trns[0] << 8 | trns[1]) ? 0 : 255;
+			}
+			break;
+
+		case 2:
+		case 6:
+			for (int c = 0; c < 3; c++) rgba[c] = scale_to_8(samples[c], maxval);
+			if (s->color_type == 6) {
+				rgba[3] = scale_to_8(samples[3], maxval);
+			} else {
+				int key = trns_n;
+				for (int c = 0; c < 3 && key; c++) key = samples[c] == (trns[c * 2] << 8 | trns[c * 2 + 1]);
+				rgba[3] = key ? 0 : 255;
+			}
+			break;
+		}
+	}
+}
+
+static void pack_row(const synth_spec_t *s, const uint16_t *samples, size_t n, uint8_t *out)
+{
+	if (s->depth == 16) {
+		for (size_t i = 0; i < n; i++) {
+			*out++ = samples[i] >> 8;
+			*out++ = samples[i];
+		}
+		return ;
+	}
+
+	if (s->depth == 8) {
+		for (size_t i = 0; i < n; i++) out[i] = (uint8_t)samples[i];
+		return ;
+	}
+
+	int bits = 0;
+	uint8_t acc = 0;
+	for (size_t i = 0; i < n; i++) {
+		acc = (acc << s->depth) | samples[i];
+		if ((bits += s->depth) == 8) {
+			*out++ = acc;
+			acc = 0;
+			bits = 0;
+		}
+	}
+	if (bits) *out = acc << (8 - bits);
+}
+
+static uint8_t paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	if (pa <= pb && pa <= pc) return a;
+	if (pb <= pc) return b;
+	return c;
+}
+
+static void filter_row(const uint8_t *cur, const uint8_t *prev, size_t stride, size_t bpp, int type, uint8_t *out)
+{
+	for (size_t i = 0; i < stride; i++) {
+		int a = i >= bpp ? cur[i - bpp] : 0;
+		int b = prev[i];
+		int c = i >= bpp ? prev[i - bpp] : 0;
+
+		switch (type) {
+		case 0: out[i] = cur[i]; break;
+		case 1: out[i] = cur[i] - a; break;
+		case 2: out[i] = cur[i] - b; break;
+		case 3: out[i] = cur[i] - ((a + b) >> 1); break;
+		case 4: out[i] = cur[i] - paeth(a, b, c); break;
+		}
+	}
+}
+
+// Appends the filtered rows of one (sub)image to raw
+static int emit_rows(const synth_spec_t *s, const uint16_t *samples, uint32_t x0, uint32_t y0, uint32_t dx, uint32_t dy, buf_t *raw)
+{
+	uint8_t ch = channels_of[s->color_type];
+	uint32_t pw = (s->w - x0 + dx - 1) / dx;
+	uint32_t ph = (s->h - y0 + dy - 1) / dy;
+	if (x0 >= s->w || y0 >= s->h || pw == 0 || ph == 0) return 0; // empty pass: no filter bytes either
+
+	size_t stride = ((size_t)pw * ch * s->depth + 7) / 8;
+	size_t bpp = (ch * s->depth + 7) / 8;
+
+	uint16_t *line = malloc((size_t)pw * ch * sizeof(uint16_t));
+	uint8_t *prev = calloc(stride, 1);
+	uint8_t *cur = malloc(stride);
+	uint8_t *cand = malloc(stride * 5);
+	if (!line || !prev || !cur || !cand) {
+		free(line); free(prev); free(cur); free(cand);
+		return -1;
+	}
+
+	int ret = 0;
+	for (uint32_t y = y0; y < s->h; y += dy) {
+		for (uint32_t i = 0, x = x0; i < pw; i++, x += dx) {
+			memcpy(line + (size_t)i * ch, samples + ((size_t)y * s->w + x) * ch, ch * sizeof(uint16_t));
+		}
+		pack_row(s, line, (size_t)pw * ch, cur);
+
+		int type = 0;
+		if (s->filter == FILTER_RANDOM) {
+			type = rng() % 5;
+			filter_row(cur, prev, stride, bpp, type, cand);
+		} else {
+			unsigned long best = ~0UL;
+			for (int t = 0; t < 5; t++) {
+				uint8_t *o = cand + stride * t;
+				filter_row(cur, prev, stride, bpp, t, o);
+				unsigned long sum = 0;
+				for (size_t i = 0; i < stride; i++) sum += abs((int8_t)o[i]);
+				if (sum < best) {
+					best = sum;
+					type = t;
+				}
+			}
+		}
+
+		uint8_t ft = (uint8_t)type;
+		if (buf_put(raw, &ft, 1) < 0 || buf_put(raw, cand + (s->filter == FILTER_RANDOM ? 0 : stride * type), stride) < 0) {
+			ret = -1;
+			break;
+		}
+
+		memcpy(prev, cur, stride);
+	}
+
+	free(line); free(prev); free(cur); free(cand);
+	return ret;
+}
+
+static int deflate_buf(const buf_t *raw, int level, int wbits, buf_t *out)
+{
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if (deflateInit2(&zs, level, Z_DEFLATED, wbits, 8, Z_DEFAULT_STRATEGY) != Z_OK) return -1;
+
+	uLong bound = deflateBound(&zs, raw->len);
+	out->data = malloc(bound);
+	out->cap = bound;
+	out->len = 0;
+	if (!out->data) {
+		deflateEnd(&zs);
+		return -1;
+	}
+
+	zs.next_in = raw->data;
+	zs.avail_in = (uInt)raw->len;
+	zs.next_out = out->data;
+	zs.avail_out = (uInt)bound;
+	int r = deflate(&zs, Z_FINISH);
+	out->len = zs.total_out;
+	deflateEnd(&zs);
+
+	return r == Z_STREAM_END ? 0 : -1;
+}
+
+static int build_image(const synth_spec_t *s, uint32_t seed, synth_image_t *img)
+{
+	uint8_t ch = channels_of[s->color_type];
+	uint16_t plte_n = s->color_type == 3 ? (s->plte_n ? s->plte_n : (1U << s->depth)) : 0;
+	uint8_t plte[256 * 3];
+	uint8_t trns[256];
+	uint16_t trns_n = 0;
+	int ret = -1;
+
+	rng_state = 0x12345678u ^ (seed * 0x9e3779b9u);
+
+	uint16_t *samples = malloc((size_t)s->w * s->h * ch * sizeof(uint16_t));
+	buf_t raw = { 0 }, z = { 0 }, png = { 0 };
+	img->rgba = malloc((size_t)s->w * s->h * 4);
+	if (!samples || !img->rgba) goto out;
+
+	if (s->color_type == 3) {
+		for (int i = 0; i < plte_n; i++) {
+			if (s->pattern == PATTERN_ART) {
+				plte[i * 3 + 0] = (i / 42) * 255 / 5;
+				plte[i * 3 + 1] = (i / 6 % 7) * 255 / 6;
+				plte[i * 3 + 2] = (i % 6) * 255 / 5;
+			} else {
+				for (int c = 0; c < 3; c++) plte[i * 3 + c] = rng();
+			}
+		}
+	}
+
+	make_samples(s, seed, samples, plte_n);
+
+	if (s->trns_n) {
+		if (s->color_type == 3) {
+			trns_n = s->trns_n;
+			for (int i = 0; i < trns_n; i++) trns[i] = rng();
+		} else {
+			// color key: the first pixel, so it always hits at least once
+			trns_n = ch * 2;
+			for (int c = 0; c < ch; c++) {
+				trns[c * 2] = samples[c] >> 8;
+				trns[c * 2 + 1] = samples[c];
+			}
+		}
+	}
+
+	make_expected(s, samples, plte, trns, trns_n, img->rgba);
+
+	// bKGD: a palette index, or 16-bit samples in the range of the bit depth; hashed so that rng() stays untouched
+	uint8_t bkgd[6];
+	size_t bkgd_n;
+	if (s->color_type == 3) {
+		bkgd[0] = hash2(seed, 0) % plte_n;
+		bkgd_n = 1;
+		memcpy(img->background, plte + bkgd[0] * 3, 3);
+	} else {
+		uint16_t maxval = (1UL << s->depth) - 1;
+		uint8_t bkgd_ch = (s->color_type & 2) ? 3 : 1;
+		for (int c = 0; c < bkgd_ch; c++) {
+			uint16_t v = hash2(seed, c) % ((uint32_t)maxval + 1);
+			bkgd[c * 2] = v >> 8;
+			bkgd[c * 2 + 1] = v;
+			img->background[c] = scale_to_8(v, maxval);
+		}
+		if (bkgd_ch == 1) img->background[1] = img->background[2] = img->background[0];
+		bkgd_n = bkgd_ch * 2;
+	}
+
+	if (s->interlace) {
+		for (int p = 0; p < 7; p++) {
+			if (emit_rows(s, samples, adam7[p][0], adam7[p][1], adam7[p][2], adam7[p][3], &raw) < 0) goto out;
+		}
+	} else {
+		if (emit_rows(s, samples, 0, 0, 1, 1, &raw) < 0) goto out;
+	}
+
+	if (deflate_buf(&raw, s->level, s->wbits, &z) < 0) goto out;
+
+	static const uint8_t sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	uint8_t ihdr[13];
+	put_be32(ihdr, s->w);
+	put_be32(ihdr + 4, s->h);
+	ihdr[8] = s->depth;
+	ihdr[9] = s->color_type;
+	ihdr[10] = 0;
+	ihdr[11] = 0;
+	ihdr[12] = s->interlace;
+
+	static const char text[] = "Comment\0pngle bench corpus";
+
+	if (buf_put(&png, sig, sizeof(sig)) < 0) goto out;
+	if (put_chunk(&png, "IHDR", ihdr, sizeof(ihdr)) < 0) goto out;
+	if (plte_n && put_chunk(&png, "PLTE", plte, plte_n * 3) < 0) goto out;
+	if (trns_n && put_chunk(&png, "tRNS", trns, trns_n) < 0) goto out;
+	if (put_chunk(&png, "bKGD", bkgd, bkgd_n) < 0) goto out;
+	if (put_chunk(&png, "tEXt", (const uint8_t *)text, sizeof(text) - 1) < 0) goto out; // skipped by the decoder
+
+	size_t split = s->idat_split ? s->idat_split : z.len;
+	for (size_t off = 0; off < z.len; off += split) {
+		if (put_chunk(&png, "IDAT", z.data + off, z.len - off < split ? z.len - off : split) < 0) goto out;
+	}
+	if (put_chunk(&png, "IEND", NULL, 0) < 0) goto out;
+
+	img->width = s->w;
+	img->height = s->h;
+	img->color_type = s->color_type;
+	img->depth = s->depth;
+	img->interlace = s->interlace;
+	img->png = png.data;
+	img->png_len = png.len;
+	png.data = NULL;
+	ret = 0;
+
+out:
+	free(samples);
+	free(raw.data);
+	free(z.data);
+	free(png.data);
+	if (ret < 0) {
+		free(img->rgba);
+		img->rgba = NULL;
+	}
+	return ret;
+}
+
+static int add_image(synth_image_t **images, int *count, const synth_spec_t *s, const char *fmt, ...)
+{
+	synth_image_t *grown = realloc(*images, (*count + 1) * sizeof(synth_image_t));
+	if (!grown) return -1;
+	*images = grown;
+
+	synth_image_t *img = &grown[*count];
+	memset(img, 0, sizeof(*img));
+	if (build_image(s, (uint32_t)*count, img) < 0) return -1;
+
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(img->name, sizeof(img->name), fmt, ap);
+	va_end(ap);
+
+	(*count)++;
+	return 0;
+}
+
+typedef struct {
+	const char *type;
+	const uint8_t *data;
+	size_t len;
+} synth_chunk_t;
+
+// Hand-built file from the given chunks (CRCs are computed), after the signature and before IEND
+static int add_malformed(synth_image_t **images, int *count, const char *name, const synth_chunk_t *chunks, size_t n)
+{
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+	synth_image_t *grown = realloc(*images, (*count + 1) * sizeof(synth_image_t));
+	if (!grown) return -1;
+	*images = grown;
+
+	synth_image_t *img = &grown[*count];
+	memset(img, 0, sizeof(*img));
+	snprintf(img->name, sizeof(img->name), "%s", name);
+	img->malformed = 1;
+
+	buf_t png = { 0 };
+	int ret = buf_put(&png, signature, sizeof(signature));
+	for (size_t i = 0; i < n && ret == 0; i++) {
+		ret = put_chunk(&png, chunks[i].type, chunks[i].data, chunks[i].len);
+		if (!strcmp(chunks[i].type, "IHDR") && chunks[i].len >= 13) {
+			const uint8_t *p = chunks[i].data;
+			img->width = (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+			img->height = (uint32_t)p[4] << 24 | p[5] << 16 | p[6] << 8 | p[7];
+			img->depth = p[8];
+			img->color_type = p[9];
+			img->interlace = p[12];
+		}
+	}
+	if (ret == 0) ret = put_chunk(&png, "IEND", NULL, 0);
+	if (ret < 0) {
+		free(png.data);
+		return -1;
+	}
+
+	img->png = png.data;
+	img->png_len = png.len;
+	(*count)++;
+	return 0;
+}
+
+static int add_malformed_corpus(synth_image_t **images, int *count)
+{
+	static const uint8_t ihdr_pal1[13] = { 0, 0, 0, 7, 0, 0, 0, 5, 1, 3, 0, 0, 0 };
+	static const uint8_t plte_bw[6] = { 0, 0, 0, 255, 255, 255 };
+
+	// Fixed Huffman block: 8 literal zeros, then length symbol 286 or 287 (invalid, no base length)
+	// with distance 1, ending 2 bytes before the 10-byte image buffer does
+	static const uint8_t idat_len286[] = { 0x78, 0x01, 0x63, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x18, 0x03 };
+	static const uint8_t idat_len287[] = { 0x78, 0x01, 0x63, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x18, 0x07 };
+
+	// 10 zero bytes: the 7x5 1-bit image, every row unfiltered and black
+	static const uint8_t idat_pal1[] = { 0x78, 0xda, 0x63, 0x60, 0x80, 0x01, 0x00, 0x00, 0x0a, 0x00, 0x01 };
+	// 110 zero bytes: a 7x5 RGB8 image
+	static const uint8_t ihdr_rgb8[13] = { 0, 0, 0, 7, 0, 0, 0, 5, 8, 2, 0, 0, 0 };
+	static const uint8_t idat_rgb8[] = { 0x78, 0xda, 0x63, 0x60, 0xa0, 0x27, 0x00, 0x00, 0x00, 0x6e, 0x00, 0x01 };
+	static const uint8_t bkgd_gray[2] = { 0x00, 0x80 };
+
+	const synth_chunk_t len286[] = { { "IHDR", ihdr_pal1, 13 }, { "PLTE", plte_bw, 6 }, { "IDAT", idat_len286, sizeof(idat_len286) } };
+	const synth_chunk_t len287[] = { { "IHDR", ihdr_pal1, 13 }, { "PLTE", plte_bw, 6 }, { "IDAT", idat_len287, sizeof(idat_len287) } };
+
+	if (add_malformed(images, count, "bad_len286", len286, 3) < 0) return -1;
+	if (add_malformed(images, count, "bad_len287", len287, 3) < 0) return -1;
+
+	// bKGD before IHDR (no bit depth to scale it with yet), and a gray-sized bKGD in an RGB image
+	const synth_chunk_t bkgd_early[] = { { "bKGD", bkgd_gray, 2 }, { "IHDR", ihdr_pal1, 13 }, { "PLTE", plte_bw, 6 }, { "IDAT", idat_pal1, sizeof(idat_pal1) } };
+	const synth_chunk_t bkgd_short[] = { { "IHDR", ihdr_rgb8, 13 }, { "bKGD", bkgd_gray, 2 }, { "IDAT", idat_rgb8, sizeof(idat_rgb8) } };
+
+	if (add_malformed(images, count, "bad_bkgd_early", bkgd_early, 4) < 0) return -1;
+	if (add_malformed(images, count, "bad_bkgd_short", bkgd_short, 3) < 0) return -1;
+
+	return 0;
+}
+
+int synth_build_corpus(synth_image_t **images)
+{
+	static const struct { uint8_t color_type; uint8_t depths[5]; } types[] = {
+		{ 0, { 1, 2, 4, 8, 16 } },
+		{ 2, { 8, 16 } },
+		{ 3, { 1, 2, 4, 8 } },
+		{ 4, { 8, 16 } },
+		{ 6, { 8, 16 } },
+	};
+	static const uint32_t sizes[][2] = { { 1, 1 }, { 7, 5 }, { 33, 17 } };
+	static const uint32_t art_sizes[] = { 64, 170, 300 };
+
+	int count = 0;
+	*images = NULL;
+
+	// conformance: every color type x bit depth x interlace, odd sizes
+	for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+		for (int d = 0; d < 5 && types[t].depths[d]; d++) {
+			for (uint8_t il = 0; il < 2; il++) {
+				synth_spec_t s = { 0, 0, types[t].color_type, types[t].depths[d], il, PATTERN_NOISE, FILTER_RANDOM, 0, 0, 15, 6, 0, NULL };
+				for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+					s.w = sizes[i][0];
+					s.h = sizes[i][1];
+					if (add_image(images, &count, &s, "c%ud%02u%s_%ux%u", s.color_type, s.depth, il ? "i" : "n", s.w, s.h) < 0) goto fail;
+				}
+				s.w = s.h = 40;
+				s.pattern = PATTERN_GRADIENT;
+				if (add_image(images, &count, &s, "c%ud%02u%s_grad", s.color_type, s.depth, il ? "i" : "n") < 0) goto fail;
+			}
+		}
+	}
+
+	// tRNS
+	static const synth_spec_t trns_specs[] = {
+		{ 16, 16, 0,  8, 0, PATTERN_GRADIENT, FILTER_RANDOM,   0,   1, 15, 6, 0, "trns_gray8" },
+		{ 16, 16, 0,  4, 1, PATTERN_GRADIENT, FILTER_RANDOM,   0,   1, 15, 6, 0, "trns_gray4i" },
+		{ 16, 16, 0, 16, 0, PATTERN_GRADIENT, FILTER_RANDOM,   0,   1, 15, 6, 0, "trns_gray16" },
+		{ 16, 16, 2,  8, 0, PATTERN_GRADIENT, FILTER_RANDOM,   0,   1, 15, 6, 0, "trns_rgb8" },
+		{ 16, 16, 2, 16, 1, PATTERN_GRADIENT, FILTER_RANDOM,   0,   1, 15, 6, 0, "trns_rgb16i" },
+		{ 16, 16, 3,  8, 0, PATTERN_NOISE,    FILTER_RANDOM, 200, 100, 15, 6, 0, "trns_pal8" },
+		{ 17, 16, 3,  4, 1, PATTERN_NOISE,    FILTER_RANDOM,   0,  16, 15, 6, 0, "trns_pal4i" },
+	};
+	for (size_t i = 0; i < sizeof(trns_specs) / sizeof(trns_specs[0]); i++) {
+		if (add_image(images, &count, &trns_specs[i], "%s", trns_specs[i].tag) < 0) goto fail;
+	}
+
+	// stream layout: LZ77 window sizes, stored blocks, tiny IDAT chunks
+	static const synth_spec_t stream_specs[] = {
+		{ 64, 64, 2, 8, 0, PATTERN_ART, FILTER_ADAPTIVE, 0, 0,  9, 6,  0, "win9" },
+		{ 64, 64, 2, 8, 0, PATTERN_ART, FILTER_ADAPTIVE, 0, 0, 12, 6,  0, "win12" },
+		{ 64, 64, 2, 8, 0, PATTERN_ART, FILTER_ADAPTIVE, 0, 0, 15, 0,  0, "stored" },
+		{ 64, 64, 2, 8, 0, PATTERN_ART, FILTER_ADAPTIVE, 0, 0, 15, 9,  7, "split7" },
+		{ 64, 64, 6, 8, 1, PATTERN_ART, FILTER_ADAPTIVE, 0, 0, 15, 1, 97, "split97i" },
+	};
+	for (size_t i = 0; i < sizeof(stream_specs) / sizeof(stream_specs[0]); i++) {
+		if (add_image(images, &count, &stream_specs[i], "%s", stream_specs[i].tag) < 0) goto fail;
+	}
+
+	// album art at the sizes the display sees
+	for (size_t i = 0; i < sizeof(art_sizes) / sizeof(art_sizes[0]); i++) {
+		uint32_t n = art_sizes[i];
+		synth_spec_t s = { n, n, 2, 8, 0, PATTERN_ART, FILTER_ADAPTIVE, 0, 0, 15, 6, 0, NULL };
+
+		if (add_image(images, &count, &s, "art%u_rgb8", n) < 0) goto fail;
+		s.color_type = 6;
+		if (add_image(images, &count, &s, "art%u_rgba8", n) < 0) goto fail;
+		s.color_type = 3;
+		s.plte_n = 252;
+		if (add_image(images, &count, &s, "art%u_pal8", n) < 0) goto fail;
+		s.color_type = 0;
+		s.plte_n = 0;
+		if (add_image(images, &count, &s, "art%u_gray8", n) < 0) goto fail;
+		s.color_type = 2;
+		s.interlace = 1;
+		if (add_image(images, &count, &s, "art%u_rgb8i", n) < 0) goto fail;
+	}
+
+	// malformed: must be rejected without reading or writing out of bounds, or stalling
+	if (add_malformed_corpus(images, &count) < 0) goto fail;
+
+	return count;
+
+fail:
+	synth_free_corpus(*images, count);
+	*images = NULL;
+	return -1;
+}
+
+void synth_free_corpus(synth_image_t *images, int count)
+{
+	for (int i = 0; i < count; i++) {
+		free(images[i].png);
+		free(images[i].rgba);
+	}
+	free(images);
+}
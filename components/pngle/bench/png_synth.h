@@ -0,0 +1,35 @@
+/*
+ * PNG corpus synthesizer for the host benchmark.
+ *
+ * Builds PngSuite-style images in memory (every color type and bit depth, interlaced and not,
+ * tRNS, bKGD, palettes, small LZ77 windows, split IDATs) plus procedural album art at 64/170/300 px,
+ * together with the RGBA8888 pixels a conforming decoder must produce for each of them, and a few
+ * malformed files it must reject.
+ */
+
+#ifndef __PNG_SYNTH_H__
+#define __PNG_SYNTH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct _synth_image_t {
+	char name[40];
+	uint32_t width;
+	uint32_t height;
+	uint8_t color_type;
+	uint8_t depth;
+	uint8_t interlace;
+	uint8_t malformed; // must fail with a decode error; rgba is NULL
+
+	uint8_t *png; // encoded file
+	size_t png_len;
+	uint8_t *rgba; // expected decode, width * height * 4
+	uint8_t background[3]; // expected pngle_get_background_color() (from bKGD)
+} synth_image_t;
+
+// returns the number of images, or -1 on error; free with synth_free_corpus()
+int synth_build_corpus(synth_image_t **images);
+void synth_free_corpus(synth_image_t *images, int count);
+
+#endif /* __PNG_SYNTH_H__ */
@@ -0,0 +1,691 @@
+/*
+ * Host-side pngle decode benchmark and conformance suite.
+ *
+ * Decodes a synthesized corpus (see png_synth.h) or the PNG files given on the command line with
+ * a counting allocator, and reports per image:
+ *   MB/s   PNG bytes consumed per second
+ *   ns/px  decode time per source pixel
+ *   peak   largest heap footprint during one decode, including pngle_t
+ *   total  bytes requested from the allocator during one decode (and the number of calls)
+ * followed by ns/px per color type and bit depth over the whole run. Synthesized images are also
+ * compared against their expected pixels and bKGD color, and malformed ones must be rejected; the exit status is
+ * non-zero on any mismatch, unexpected decode error or accepted malformed file.
+ * With -s or -o the expected pixels are scaled and packed by a reference written independently of pngle's tables.
+ *
+ * usage: pngle_bench [-t seconds] [-c chunk] [-m row|pixel|buffer] [-r] [-n] [-p] [-f bkgd|RRGGBB] [-l limit]
+ *                    [-s WxH[,box]] [-o rgba|rgb565|rgb565swap] [-u] [-j threads] [file.png ...]
+ *   -t  minimum timed duration per image (default 0.2)
+ *   -c  feed the PNG in chunks of this many bytes, like MQTT fragments (default: all at once)
+ *   -m  output path: row callback (default), per-pixel draw callback, or RGBA8888 output buffer
+ *   -r  reuse one decoder across decodes (pngle_reset) instead of pngle_new per decode
+ *   -n  don't verify IDAT CRCs (pngle_set_idat_crc_check)
+ *   -p  progressive interlace previews in the output buffer (implies -m buffer); reports how much of each
+ *       interlaced file had been fed when passes 1 and 3 were complete (use with -c)
+ *   -f  flatten alpha against the image's bKGD color or the given one (pngle_set_flatten)
+ *   -l  inflate images with up to this many bytes of filtered rows in one piece (pngle_set_linear_inflate_limit)
+ *   -s  scale to WxH with a center crop (pngle_set_scaling), nearest or box filter (implies -m buffer; a later -m
+ *       scales through callbacks, which pngle refuses for interlaced images)
+ *   -o  output buffer pixel format (implies -m buffer)
+ *   -u  suspend from the init, row and pass callbacks (pngle_suspend), resuming with the next feed
+ *   -j  afterwards, decode the whole corpus on this many threads at once, one decoder and allocator per thread,
+ *       checking every result; reports the combined throughput
+ *
+ * The CRC-32 implementation is a build option: cmake -DMINIZ_CRC32_METHOD=0|1|4|8 (see miniz.c).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "pngle.h"
+#include "png_synth.h"
+
+typedef enum {
+	MODE_ROW,
+	MODE_PIXEL,
+	MODE_BUFFER,
+} bench_mode_t;
+
+typedef struct {
+	size_t current;
+	size_t peak;
+	size_t total;
+	size_t calls;
+} heap_stats_t;
+
+typedef struct {
+	uint8_t *canvas;
+	uint32_t width;
+	uint32_t height;
+	bench_mode_t mode;
+	int idat_crc;
+	int progressive;
+	pngle_flatten_t flatten;
+	uint8_t flatten_rgb[3];
+	size_t linear_limit;
+	pngle_pixel_format_t format; // output buffer
+	uint32_t scale_w; // 0: no scaling
+	uint32_t scale_h;
+	pngle_scale_filter_t scale_filter;
+	int suspend;
+	int suspended; // a callback suspended the current pngle_feed()
+	size_t fed; // bytes handed to pngle_feed() so far
+	size_t pass_fed[8]; // fed when each interlace pass was complete
+} canvas_t;
+
+typedef struct {
+	double time;
+	double pixels;
+	int images;
+} format_stats_t;
+
+typedef union {
+	size_t size;
+	max_align_t align;
+} heap_block_t;
+
+static void *counting_alloc(void *ctx, size_t size)
+{
+	heap_stats_t *stats = (heap_stats_t *)ctx;
+	heap_block_t *block = malloc(sizeof(heap_block_t) + size);
+	if (!block) return NULL;
+
+	block->size = size;
+	stats->current += size;
+	stats->total += size;
+	stats->calls++;
+	if (stats->current > stats->peak) stats->peak = stats->current;
+
+	return block + 1;
+}
+
+static void counting_free(void *ctx, void *ptr)
+{
+	heap_stats_t *stats = (heap_stats_t *)ctx;
+	if (!ptr) return ;
+
+	heap_block_t *block = (heap_block_t *)ptr - 1;
+	stats->current -= block->size;
+	free(block);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t pixel_size(pngle_pixel_format_t format)
+{
+	return format == PNGLE_PIXEL_FORMAT_RGBA8888 ? 4 : 2;
+}
+
+static void suspend(pngle_t *pngle, canvas_t *c)
+{
+	if (!c->suspend) return ;
+	pngle_suspend(pngle);
+	c->suspended = 1;
+}
+
+static void on_init(pngle_t *pngle, uint32_t w, uint32_t h)
+{
+	canvas_t *c = (canvas_t *)pngle_get_user_data(pngle);
+	size_t bpp = pixel_size(c->format);
+
+	if (c->scale_w) {
+		w = c->scale_w;
+		h = c->scale_h;
+	}
+	if (w != c->width || h != c->height) {
+		free(c->canvas);
+		c->canvas = malloc((size_t)w * h * 4);
+		c->width = w;
+		c->height = h;
+	}
+	if (c->canvas) memset(c->canvas, 0, (size_t)w * h * 4);
+
+	if (c->mode == MODE_BUFFER) pngle_set_output_buffer(pngle, c->format, c->canvas, w * bpp, w, h);
+	suspend(pngle, c);
+}
+
+static void on_row(pngle_t *pngle, uint32_t x, uint32_t y, uint32_t dx, uint32_t n, const uint8_t *rgba)
+{
+	canvas_t *c = (canvas_t *)pngle_get_user_data(pngle);
+	uint8_t *dst = c->canvas + ((size_t)y * c->width + x) * 4;
+
+	suspend(pngle, c);
+	if (dx == 1) {
+		memcpy(dst, rgba, (size_t)n * 4);
+		return ;
+	}
+	for (uint32_t i = 0; i < n; i++, rgba += 4, dst += dx * 4) memcpy(dst, rgba, 4);
+}
+
+static void on_draw(pngle_t *pngle, uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint8_t rgba[4])
+{
+	canvas_t *c = (canvas_t *)pngle_get_user_data(pngle);
+
+	suspend(pngle, c);
+	// interlace passes draw blocks; the last pass leaves every pixel exact
+	for (uint32_t j = y; j < y + h && j < c->height; j++) {
+		for (uint32_t i = x; i < x + w && i < c->width; i++) memcpy(c->canvas + ((size_t)j * c->width + i) * 4, rgba, 4);
+	}
+}
+
+static void on_pass(pngle_t *pngle, int pass)
+{
+	canvas_t *c = (canvas_t *)pngle_get_user_data(pngle);
+	c->pass_fed[pass] = c->fed;
+	suspend(pngle, c);
+}
+
+static int decode(pngle_t *pngle, const uint8_t *png, size_t len, size_t chunk)
+{
+	canvas_t *c = (canvas_t *)pngle_get_user_data(pngle);
+	size_t pos = 0;
+	size_t avail = 0;
+
+	memset(c->pass_fed, 0, sizeof(c->pass_fed));
+	c->suspended = 0;
+	while (pos < len || c->suspended) {
+		avail = avail + chunk > len - pos ? len - pos : avail + chunk;
+		c->fed = pos + avail;
+
+		c->suspended = 0;
+		int n = pngle_feed(pngle, png + pos, avail);
+		if (n < 0) return -1;
+
+		pos += n;
+		avail -= n;
+		if (n == 0 && !c->suspended && pos + avail >= len) break; // truncated
+	}
+
+	return 0;
+}
+
+static void setup(pngle_t *pngle, canvas_t *c)
+{
+	pngle_set_user_data(pngle, c);
+	pngle_set_init_callback(pngle, on_init);
+	pngle_set_row_callback(pngle, c->mode == MODE_ROW ? on_row : NULL);
+	pngle_set_draw_callback(pngle, c->mode == MODE_PIXEL ? on_draw : NULL);
+	pngle_set_idat_crc_check(pngle, c->idat_crc);
+	pngle_set_progressive(pngle, c->progressive);
+	pngle_set_pass_callback(pngle, c->progressive || c->suspend ? on_pass : NULL);
+	pngle_set_scaling(pngle, c->scale_w, c->scale_h, 0, 0, 0, 0, c->scale_filter);
+	pngle_set_flatten(pngle, c->flatten, c->flatten_rgb);
+	pngle_set_linear_inflate_limit(pngle, c->linear_limit);
+}
+
+// expected source pixel, flattened the way setup() asked for
+static void reference_source(const canvas_t *c, const synth_image_t *img, uint32_t x, uint32_t y, uint8_t out[4])
+{
+	const uint8_t *e = img->rgba + ((size_t)y * img->width + x) * 4;
+	if (c->flatten == PNGLE_FLATTEN_NONE) {
+		memcpy(out, e, 4);
+		return ;
+	}
+
+	const uint8_t *matte = c->flatten == PNGLE_FLATTEN_BKGD ? img->background : c->flatten_rgb;
+	for (int k = 0; k < 3; k++) out[k] = (uint8_t)floor((e[k] * e[3] + matte[k] * (255 - e[3])) / 255.0 + 0.5);
+	out[3] = 255;
+}
+
+// expected output pixel: the source, or the center crop of it sampled or averaged down to scale_w x scale_h
+static void reference_pixel(const canvas_t *c, const synth_image_t *img, uint32_t x, uint32_t y, uint8_t out[4])
+{
+	if (!c->scale_w) {
+		reference_source(c, img, x, y, out);
+		return ;
+	}
+
+	// largest centered rectangle with the output's aspect ratio
+	double aspect = (double)c->scale_w / c->scale_h;
+	uint32_t cw = img->width;
+	uint32_t ch = img->height;
+	if ((double)img->width / img->height > aspect) {
+		cw = (uint32_t)floor(img->height * aspect + 1e-9);
+	} else {
+		ch = (uint32_t)floor(img->width / aspect + 1e-9);
+	}
+	if (cw == 0) cw = 1;
+	if (ch == 0) ch = 1;
+	uint32_t cx = (img->width - cw) / 2;
+	uint32_t cy = (img->height - ch) / 2;
+
+	int box = c->scale_filter == PNGLE_SCALE_BOX && !img->interlace && c->scale_w <= cw && c->scale_h <= ch;
+	if (!box) {
+		// sample at the center of the output pixel
+		uint32_t sx = cx + (uint32_t)floor((x + 0.5) * cw / c->scale_w);
+		uint32_t sy = cy + (uint32_t)floor((y + 0.5) * ch / c->scale_h);
+		reference_source(c, img, sx, sy, out);
+		return ;
+	}
+
+	// every source pixel whose left/top edge falls in the output pixel
+	uint32_t sum[4] = { 0 };
+	uint32_t n = 0;
+	for (uint32_t sy = 0; sy < ch; sy++) {
+		if ((uint64_t)sy * c->scale_h / ch != y) continue;
+		for (uint32_t sx = 0; sx < cw; sx++) {
+			if ((uint64_t)sx * c->scale_w / cw != x) continue;
+			uint8_t p[4];
+			reference_source(c, img, cx + sx, cy + sy, p);
+			for (int k = 0; k < 4; k++) sum[k] += p[k];
+			n++;
+		}
+	}
+	for (int k = 0; k < 4; k++) out[k] = n ? (uint8_t)floor((double)sum[k] / n + 0.5) : 0;
+}
+
+// pngle can only scale interlaced images into an output buffer
+static int unsupported(const canvas_t *c, const synth_image_t *img)
+{
+	return c->scale_w && c->mode != MODE_BUFFER && img->interlace;
+}
+
+// compares the canvas with the reference, packed in the output format
+static int check_pixels(const canvas_t *c, const synth_image_t *img)
+{
+	uint32_t w = c->scale_w ? c->scale_w : img->width;
+	uint32_t h = c->scale_w ? c->scale_h : img->height;
+	if (!c->canvas || c->width != w || c->height != h) return 0;
+
+	size_t bpp = pixel_size(c->format);
+	for (uint32_t y = 0; y < h; y++) {
+		for (uint32_t x = 0; x < w; x++) {
+			const uint8_t *p = c->canvas + ((size_t)y * w + x) * bpp;
+			uint8_t e[4];
+			reference_pixel(c, img, x, y, e);
+
+			if (c->format == PNGLE_PIXEL_FORMAT_RGBA8888) {
+				if (memcmp(p, e, 4)) return 0;
+				continue;
+			}
+			uint16_t v = (uint16_t)((e[0] >> 3) << 11 | (e[1] >> 2) << 5 | e[2] >> 3);
+			uint8_t packed[2];
+			if (c->format == PNGLE_PIXEL_FORMAT_RGB565_SWAP) {
+				packed[0] = v >> 8;
+				packed[1] = v & 0xff;
+			} else {
+				memcpy(packed, &v, 2); // native byte order
+			}
+			if (memcmp(p, packed, 2)) return 0;
+		}
+	}
+	return 1;
+}
+
+typedef struct {
+	pthread_t thread;
+	const synth_image_t *images;
+	int count;
+	int first; // threads start at different images so that different formats decode side by side
+	double min_time;
+	size_t chunk;
+	canvas_t canvas;
+	int reuse;
+	double bytes;
+	int decodes;
+	int failures;
+} worker_t;
+
+static void *worker_main(void *arg)
+{
+	worker_t *w = (worker_t *)arg;
+	heap_stats_t stats = { 0 };
+	const pngle_allocator_t allocator = { counting_alloc, counting_free, &stats };
+	pngle_t *shared = w->reuse ? pngle_new_with_allocator(&allocator) : NULL;
+	double start = now();
+
+	do {
+		for (int k = 0; k < w->count; k++) {
+			const synth_image_t *img = &w->images[(w->first + k) % w->count];
+
+			if (shared) pngle_reset(shared);
+			pngle_t *pngle = shared ? shared : pngle_new_with_allocator(&allocator);
+			setup(pngle, &w->canvas);
+			int ok = decode(pngle, img->png, img->png_len, w->chunk ? w->chunk : img->png_len) == 0;
+			if (!shared) pngle_destroy(pngle);
+
+			if (ok && img->rgba) ok = check_pixels(&w->canvas, img);
+			if (img->malformed) ok = !ok;
+			else if (!ok && unsupported(&w->canvas, img)) ok = 1;
+			if (!ok) w->failures++;
+			w->bytes += img->png_len;
+			w->decodes++;
+		}
+	} while (now() - start < w->min_time);
+
+	if (shared) pngle_destroy(shared);
+	free(w->canvas.canvas);
+	return NULL;
+}
+
+// Decodes the corpus on several threads at once; every thread owns its decoder, allocator and canvas
+static int run_parallel(const synth_image_t *images, int count, int jobs, const worker_t *config)
+{
+	worker_t *workers = calloc(jobs, sizeof(worker_t));
+	if (!workers) return -1;
+
+	double start = now();
+	int started = 0;
+	for (; started < jobs; started++) {
+		worker_t *w = &workers[started];
+		*w = *config;
+		w->images = images;
+		w->count = count;
+		w->first = started * count / jobs;
+		if (pthread_create(&w->thread, NULL, worker_main, w) != 0) break;
+	}
+
+	double bytes = 0;
+	int decodes = 0;
+	int failures = 0;
+	for (int t = 0; t < started; t++) {
+		pthread_join(workers[t].thread, NULL);
+		bytes += workers[t].bytes;
+		decodes += workers[t].decodes;
+		failures += workers[t].failures;
+	}
+	double elapsed = now() - start;
+	free(workers);
+
+	if (started < jobs) {
+		fprintf(stderr, "could only start %d of %d threads\n", started, jobs);
+		failures++;
+	}
+	printf("\n%d threads: %d decodes, %d failed; %.1f MB/s combined\n",
+		started, decodes, failures, elapsed > 0 ? bytes / elapsed / 1e6 : 0);
+
+	return failures;
+}
+
+static const char *color_type_name(uint8_t color_type)
+{
+	switch (color_type) {
+	case 0: return "gray";
+	case 2: return "rgb";
+	case 3: return "pal";
+	case 4: return "graya";
+	case 6: return "rgba";
+	}
+	return "?";
+}
+
+static int load_file(const char *path, synth_image_t *img)
+{
+	FILE *fp = fopen(path, "rb");
+	if (!fp) return -1;
+
+	fseek(fp, 0, SEEK_END);
+	long len = ftell(fp);
+	rewind(fp);
+
+	memset(img, 0, sizeof(*img));
+	img->png = malloc(len > 0 ? len : 1);
+	if (!img->png || fread(img->png, 1, len, fp) != (size_t)len) {
+		fclose(fp);
+		free(img->png);
+		return -1;
+	}
+	fclose(fp);
+
+	const char *base = strrchr(path, '/');
+	snprintf(img->name, sizeof(img->name), "%s", base ? base + 1 : path);
+	img->png_len = len;
+
+	// IHDR, for the listing only; the decoder validates it
+	if (len >= 29) {
+		const uint8_t *p = img->png + 16;
+		img->width = (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+		img->height = (uint32_t)p[4] << 24 | p[5] << 16 | p[6] << 8 | p[7];
+		img->depth = p[8];
+		img->color_type = p[9];
+		img->interlace = p[12];
+	}
+
+	return 0;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-t seconds] [-c chunk] [-m row|pixel|buffer] [-r] [-n] [-p] [-f bkgd|RRGGBB] [-l limit]"
+		" [-s WxH[,box]] [-o rgba|rgb565|rgb565swap] [-u] [-j threads] [file.png ...]\n", argv0);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	double min_time = 0.2;
+	size_t chunk = 0;
+	bench_mode_t mode = MODE_ROW;
+	int reuse = 0;
+	int idat_crc = 1;
+	int progressive = 0;
+	pngle_flatten_t flatten = PNGLE_FLATTEN_NONE;
+	uint8_t flatten_rgb[3] = { 0 };
+	size_t linear_limit = 0;
+	pngle_pixel_format_t format = PNGLE_PIXEL_FORMAT_RGBA8888;
+	uint32_t scale_w = 0;
+	uint32_t scale_h = 0;
+	pngle_scale_filter_t scale_filter = PNGLE_SCALE_NEAREST;
+	int suspend_rows = 0;
+	int jobs = 0;
+
+	int argi = 1;
+	for (; argi < argc && argv[argi][0] == '-'; argi++) {
+		const char *opt = argv[argi];
+		if (!strcmp(opt, "-r")) {
+			reuse = 1;
+		} else if (!strcmp(opt, "-n")) {
+			idat_crc = 0;
+		} else if (!strcmp(opt, "-u")) {
+			suspend_rows = 1;
+		} else if (!strcmp(opt, "-p")) {
+			progressive = 1;
+			mode = MODE_BUFFER;
+		} else if (argi + 1 < argc && !strcmp(opt, "-t")) {
+			min_time = atof(argv[++argi]);
+		} else if (argi + 1 < argc && !strcmp(opt, "-f")) {
+			const char *f = argv[++argi];
+			if (!strcmp(f, "bkgd")) {
+				flatten = PNGLE_FLATTEN_BKGD;
+			} else {
+				unsigned long rgb = strtoul(f, NULL, 16);
+				flatten = PNGLE_FLATTEN_COLOR;
+				flatten_rgb[0] = rgb >> 16;
+				flatten_rgb[1] = rgb >> 8;
+				flatten_rgb[2] = rgb;
+			}
+		} else if (argi + 1 < argc && !strcmp(opt, "-s")) {
+			char filter[8] = "";
+			int n = sscanf(argv[++argi], "%ux%u,%7s", &scale_w, &scale_h, filter);
+			if (n < 2 || !scale_w || !scale_h || (n == 3 && strcmp(filter, "box"))) usage(argv[0]);
+			scale_filter = n == 3 ? PNGLE_SCALE_BOX : PNGLE_SCALE_NEAREST;
+			mode = MODE_BUFFER;
+		} else if (argi + 1 < argc && !strcmp(opt, "-o")) {
+			const char *o = argv[++argi];
+			if (!strcmp(o, "rgba")) format = PNGLE_PIXEL_FORMAT_RGBA8888;
+			else if (!strcmp(o, "rgb565")) format = PNGLE_PIXEL_FORMAT_RGB565;
+			else if (!strcmp(o, "rgb565swap")) format = PNGLE_PIXEL_FORMAT_RGB565_SWAP;
+			else usage(argv[0]);
+			mode = MODE_BUFFER;
+		} else if (argi + 1 < argc && !strcmp(opt, "-l")) {
+			linear_limit = strtoul(argv[++argi], NULL, 0);
+		} else if (argi + 1 < argc && !strcmp(opt, "-j")) {
+			jobs = atoi(argv[++argi]);
+		} else if (argi + 1 < argc && !strcmp(opt, "-c")) {
+			chunk = strtoul(argv[++argi], NULL, 0);
+		} else if (argi + 1 < argc && !strcmp(opt, "-m")) {
+			const char *m = argv[++argi];
+			if (!strcmp(m, "row")) mode = MODE_ROW;
+			else if (!strcmp(m, "pixel")) mode = MODE_PIXEL;
+			else if (!strcmp(m, "buffer")) mode = MODE_BUFFER;
+			else usage(argv[0]);
+		} else {
+			usage(argv[0]);
+		}
+	}
+
+	synth_image_t *images = NULL;
+	int count;
+	if (argi < argc) {
+		count = argc - argi;
+		images = calloc(count, sizeof(synth_image_t));
+		for (int i = 0; i < count; i++) {
+			if (load_file(argv[argi + i], &images[i]) < 0) {
+				fprintf(stderr, "%s: cannot read\n", argv[argi + i]);
+				return 2;
+			}
+		}
+	} else {
+		count = synth_build_corpus(&images);
+		if (count < 0) {
+			fprintf(stderr, "failed to synthesize the corpus\n");
+			return 2;
+		}
+	}
+
+	heap_stats_t stats = { 0 };
+	const pngle_allocator_t allocator = { counting_alloc, counting_free, &stats };
+	canvas_t canvas = { NULL, 0, 0, mode, idat_crc, progressive, flatten, { flatten_rgb[0], flatten_rgb[1], flatten_rgb[2] }, linear_limit,
+		format, scale_w, scale_h, scale_filter, suspend_rows, 0, 0, { 0 } };
+	pngle_t *shared = reuse ? pngle_new_with_allocator(&allocator) : NULL;
+
+	printf("%-20s %9s %-6s %4s %8s %8s %8s %9s %9s %6s  %s\n",
+		"image", "size", "type", "bits", "PNG KB", "MB/s", "ns/px", "peak KB", "total KB", "allocs", "check");
+
+	int failures = 0;
+	double all_time = 0;
+	double all_bytes = 0;
+	double all_pixels = 0;
+	size_t max_peak = 0;
+	format_stats_t formats[7][17] = { 0 }; // [color type][bit depth]
+	double pass1_fed = 0;
+	double pass3_fed = 0;
+	double interlaced_bytes = 0;
+	int interlaced = 0;
+
+	for (int i = 0; i < count; i++) {
+		synth_image_t *img = &images[i];
+		size_t feed = chunk ? chunk : img->png_len;
+
+		// first decode: heap figures and conformance
+		if (shared) pngle_reset(shared);
+		stats.peak = stats.current; // with -r, buffers kept from the previous image count towards the peak
+		stats.total = 0;
+		stats.calls = 0;
+
+		pngle_t *pngle = shared ? shared : pngle_new_with_allocator(&allocator);
+		setup(pngle, &canvas);
+		int ok = decode(pngle, img->png, img->png_len, feed) == 0;
+		const char *error = ok ? NULL : pngle_error(pngle);
+		int bkgd_ok = !memcmp(pngle_get_background_color(pngle), img->background, 3);
+
+		if (ok && progressive && img->interlace && canvas.pass_fed[3]) {
+			pass1_fed += canvas.pass_fed[1];
+			pass3_fed += canvas.pass_fed[3];
+			interlaced_bytes += img->png_len;
+			interlaced++;
+		}
+
+		size_t peak = stats.peak;
+		size_t total = stats.total;
+		size_t calls = stats.calls;
+		if (!shared) pngle_destroy(pngle);
+		if (peak > max_peak) max_peak = peak;
+
+		const char *check = "-";
+		if (img->malformed) {
+			check = ok ? "ACCEPTED" : "rejected";
+			if (ok) failures++;
+		} else if (!ok && unsupported(&canvas, img)) {
+			check = "unsupported";
+		} else if (!ok) {
+			check = error;
+			failures++;
+		} else if (img->rgba) {
+			int match = check_pixels(&canvas, img);
+			check = !match ? "MISMATCH" : !bkgd_ok ? "BKGD" : "ok";
+			if (!match || !bkgd_ok) failures++;
+		}
+
+		// timed decodes
+		int reps = 0;
+		double elapsed = 0;
+		double start = now();
+		if (ok) {
+			do {
+				if (shared) pngle_reset(shared);
+				pngle = shared ? shared : pngle_new_with_allocator(&allocator);
+				setup(pngle, &canvas);
+				decode(pngle, img->png, img->png_len, feed);
+				if (!shared) pngle_destroy(pngle);
+				reps++;
+				elapsed = now() - start;
+			} while (elapsed < min_time);
+		}
+
+		double per = reps ? elapsed / reps : 0;
+		double pixels = (double)img->width * img->height;
+		char size[16];
+		snprintf(size, sizeof(size), "%ux%u", img->width, img->height);
+
+		printf("%-20s %9s %-5s%s %4u %8.1f %8.1f %8.1f %9.1f %9.1f %6zu  %s\n",
+			img->name, size, color_type_name(img->color_type), img->interlace ? "i" : " ", img->depth,
+			img->png_len / 1024.0, per > 0 ? img->png_len / per / 1e6 : 0, pixels > 0 ? per * 1e9 / pixels : 0,
+			peak / 1024.0, total / 1024.0, calls, check);
+
+		if (reps) {
+			all_time += per;
+			all_bytes += img->png_len;
+			all_pixels += pixels;
+
+			if (img->color_type < 7 && img->depth < 17) {
+				format_stats_t *f = &formats[img->color_type][img->depth];
+				f->time += per;
+				f->pixels += pixels;
+				f->images++;
+			}
+		}
+	}
+
+	printf("\n%-6s %4s %6s %8s\n", "type", "bits", "images", "ns/px");
+	for (int t = 0; t < 7; t++) {
+		for (int d = 0; d < 17; d++) {
+			format_stats_t *f = &formats[t][d];
+			if (!f->images) continue;
+			printf("%-6s %4d %6d %8.1f\n", color_type_name(t), d, f->images, f->pixels > 0 ? f->time * 1e9 / f->pixels : 0);
+		}
+	}
+
+	if (interlaced) {
+		printf("\n%d interlaced images: pass 1 preview after %.1f%% of their bytes, pass 3 after %.1f%%\n",
+			interlaced, pass1_fed * 100 / interlaced_bytes, pass3_fed * 100 / interlaced_bytes);
+	}
+
+	printf("\n%d images, %d failed; %.1f MB/s, %.1f ns/px overall, max peak %.1f KB\n",
+		count, failures, all_time > 0 ? all_bytes / all_time / 1e6 : 0, all_pixels > 0 ? all_time * 1e9 / all_pixels : 0, max_peak / 1024.0);
+
+	if (jobs > 0) {
+		worker_t config = { 0 };
+		config.min_time = min_time;
+		config.chunk = chunk;
+		config.canvas = canvas;
+		config.canvas.canvas = NULL;
+		config.canvas.width = config.canvas.height = 0;
+		config.reuse = reuse;
+		if (run_parallel(images, count, jobs, &config) != 0) failures++;
+	}
+
+	if (shared) pngle_destroy(shared);
+	free(canvas.canvas);
+	synth_free_corpus(images, count);
+
+	return failures ? 1 : 0;
+}
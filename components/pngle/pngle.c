@@ -32,6 +32,7 @@
 
 #ifndef MIN
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
 #endif
 
 #ifdef PNGLE_DEBUG
@@ -41,16 +42,14 @@
 #endif
 
 #define PNGLE_ERROR(s) (pngle->error = (s), pngle->state = PNGLE_STATE_ERROR, -1)
-// Use malloc+memset instead of calloc for better ESP-IDF compatibility
-#define PNGLE_CALLOC(a, b, name) ({ \
-    size_t _size = (size_t)(a) * (size_t)(b); \
-    void *_ptr = malloc(_size); \
-    if (_ptr) memset(_ptr, 0, _size); \
-    _ptr; \
-})
+#define PNGLE_CALLOC(a, b, name) pngle_calloc(pngle, (a), (b), (name))
+#define PNGLE_RESERVE(p, a, b, name) pngle_reserve(pngle, (void **)&(p), (a), (b), (name))
+#define PNGLE_FREE(p) pngle_free(pngle, (p))
 
 #define PNGLE_UNUSED(x) (void)(x)
 
+#define SCANLINE_LEAD 8 // zero bytes in front of each row; >= max bytes per pixel and keeps rows word aligned
+
 typedef enum {
 	PNGLE_STATE_ERROR = -2,
 	PNGLE_STATE_EOF = -1,
@@ -61,6 +60,12 @@ typedef enum {
 	PNGLE_STATE_CRC,
 } pngle_state_t;
 
+// chunks seen in the current image (buffers are kept across pngle_reset(), so they can't tell)
+#define PNGLE_FLAG_PLTE  0x01
+#define PNGLE_FLAG_tRNS  0x02
+#define PNGLE_FLAG_GAMMA 0x04
+#define PNGLE_FLAG_bKGD  0x08
+
 typedef enum {
 // Supported chunks
 //   Filter chunk names by following command to (re)generate hex constants;
@@ -71,15 +76,20 @@ typedef enum {
 	PNGLE_CHUNK_IEND = 0x49454e44UL, // IEND
 	PNGLE_CHUNK_tRNS = 0x74524e53UL, // tRNS
 	PNGLE_CHUNK_gAMA = 0x67414d41UL, // gAMA
-	PNGLE_CHUNK_bKGD = 0x424b4744UL, // bKGD
+	PNGLE_CHUNK_bKGD = 0x624b4744UL, // bKGD
 } pngle_chunk_t;
 
+// converts n packed pixels of a row into RGBA8888
+typedef void (*pngle_row_converter_t)(const uint8_t *src, uint8_t *rgba, size_t n);
+
 // typedef struct _pngle_t pngle_t; // declared in pngle.h
 struct _pngle_t {
 	pngle_ihdr_t hdr;
 
 	uint_fast8_t channels; // 0 indicates IHDR hasn't been processed yet
 
+	uint_fast8_t flags; // PNGLE_FLAG_*
+
 	// PLTE chunk
 	size_t n_palettes;
 	uint8_t *palette;
@@ -88,6 +98,11 @@ struct _pngle_t {
 	size_t n_trans_palettes;
 	uint8_t *trans_palette;
 
+	// color type 3: palette resolved once (set up on the first IDAT)
+	uint8_t *palette_lut; // 256 x RGBA8888, tRNS and gamma applied
+	uint8_t *palette_lut_out; // 256 x 2 bytes in out_format, for RGB565 output buffers
+	int_fast8_t palette_lut_format; // out_format palette_lut_out is built for, -1 if none
+
 	// bKGD chunk
 	uint8_t background_color[3];
 
@@ -98,14 +113,46 @@ struct _pngle_t {
 	mz_ulong crc32;
 
 	// scanline decoder (reset on every set_interlace_pass() call)
-	uint8_t *scanline_ringbuf;
-	size_t scanline_ringbuf_size;
-	size_t scanline_ringbuf_cidx;
-	int_fast8_t scanline_remain_bytes_to_render;
+	uint8_t *scanline_buf; // two rows, each preceded by SCANLINE_LEAD zero bytes
+	uint8_t *scanline_prev;
+	uint8_t *scanline_cur;
+	size_t scanline_stride;
+	size_t scanline_filled;
 	int_fast8_t filter_type;
 	uint32_t drawing_x;
 	uint32_t drawing_y;
 
+	// row buffer (reset on every set_interlace_pass() call)
+	uint8_t *row_rgba;
+	size_t row_pixels;
+	pngle_row_converter_t convert_row; // chosen on the first IDAT, NULL selects the generic per-pixel path
+
+	// output buffer (bypasses draw/row callbacks if set)
+	pngle_pixel_format_t out_format;
+	uint8_t *out_buf;
+	uint32_t out_stride;
+	uint32_t out_width;
+	uint32_t out_height;
+
+	// scaling & cropping (tables are set up on the very first IDAT)
+	uint32_t scale_w; // 0 indicates scaling is disabled
+	uint32_t scale_h;
+	uint32_t crop_x;
+	uint32_t crop_y;
+	uint32_t crop_w; // 0 indicates center crop to the aspect ratio of scale_w x scale_h
+	uint32_t crop_h;
+	pngle_scale_filter_t scale_filter;
+	uint32_t src_x; // effective crop rectangle and filter of the current image
+	uint32_t src_y;
+	uint32_t src_w;
+	uint32_t src_h;
+	pngle_scale_filter_t src_filter;
+	uint32_t *scale_xtab; // nearest: source x for each output column, box: source pixels per output column
+	uint32_t *scale_acc; // box: RGBA sums for the output row being accumulated
+	uint8_t *scale_row; // output row handed to callbacks
+	uint32_t scale_acc_y;
+	uint32_t scale_acc_rows;
+
 	// interlace
 	uint_fast8_t interlace_pass;
 
@@ -114,10 +161,20 @@ struct _pngle_t {
 	double display_gamma;
 #endif
 
+	uint_fast8_t skip_idat_crc; // see pngle_set_idat_crc_check()
+	uint_fast8_t progressive; // see pngle_set_progressive()
+	size_t linear_limit; // see pngle_set_linear_inflate_limit()
+	pngle_flatten_t flatten; // see pngle_set_flatten()
+	uint8_t flatten_color[3];
+	uint_fast8_t flattening; // the current image has alpha to flatten (set up on the first IDAT)
+	uint8_t matte[3]; // the color it is flattened against
+
 	// callbacks
 	pngle_init_callback_t init_callback;
 	pngle_draw_callback_t draw_callback;
+	pngle_row_callback_t row_callback;
 	pngle_done_callback_t done_callback;
+	pngle_pass_callback_t pass_callback;
 
 	// misc
 	const char *error;
@@ -126,18 +183,34 @@ struct _pngle_t {
 	// decompression state (reset on IHDR)
 	uint8_t *next_out; // NULL indicates IDAT hasn't been processed yet
 	size_t  avail_out;
-	tinfl_decompressor inflator; // 11000 bytes
-	uint8_t lz_buf[TINFL_LZ_DICT_SIZE]; // 32768 bytes
+	tinfl_decompressor inflator; // 15096 bytes (11000 with TINFL_FAST_LOOP=0)
+	uint8_t *lz_buf; // LZ77 window declared in the zlib header (256 - 32768 bytes), or the whole image data (see lz_linear)
+	size_t lz_buf_size;
+	uint_fast8_t lz_linear; // lz_buf holds all filtered rows of the image, so tinfl never wraps around it
+	const uint8_t *lz_pending; // inflated bytes not handed to the scanline decoder yet (see pngle_suspend)
+	size_t lz_pending_len;
+	uint_fast8_t suspended;
+
+	// memory accounting (reset on pngle_reset)
+	pngle_allocator_t allocator;
+	size_t mem_current;
+	size_t mem_peak;
 };
 
 const size_t PNGLE_T_SIZE = sizeof(pngle_t);
 
+// Every block carries its size so that the peak allocation can be tracked (see pngle_get_peak_memory())
+typedef union {
+	size_t size;
+	uint64_t align; // keeps blocks 8-byte aligned
+} pngle_block_t;
+
 // magic
 static const uint8_t png_sig[] = { 137, 80, 78, 71, 13, 10, 26, 10 };
-static uint32_t interlace_off_x[8] = { 0,  0, 4, 0, 2, 0, 1, 0 };
-static uint32_t interlace_off_y[8] = { 0,  0, 0, 4, 0, 2, 0, 1 };
-static uint32_t interlace_div_x[8] = { 1,  8, 8, 4, 4, 2, 2, 1 };
-static uint32_t interlace_div_y[8] = { 1,  8, 8, 8, 4, 4, 2, 2 };
+static const uint32_t interlace_off_x[8] = { 0,  0, 4, 0, 2, 0, 1, 0 };
+static const uint32_t interlace_off_y[8] = { 0,  0, 0, 4, 0, 2, 0, 1 };
+static const uint32_t interlace_div_x[8] = { 1,  8, 8, 4, 4, 2, 2, 1 };
+static const uint32_t interlace_div_y[8] = { 1,  8, 8, 8, 4, 4, 2, 2 };
 
 
 static inline uint8_t  read_uint8(const uint8_t *p)
@@ -162,6 +235,64 @@ static inline uint32_t U32_CLAMP_ADD(uint32_t a, uint32_t b, uint32_t top)
 	return v;
 }
 
+static void *pngle_calloc(pngle_t *pngle, size_t n, size_t size, const char *name)
+{
+	if (size && n > (SIZE_MAX - sizeof(pngle_block_t)) / size) return NULL;
+
+	size_t bytes = n * size;
+
+	// Use alloc+memset instead of calloc for better ESP-IDF compatibility
+	pngle_block_t *block = (pngle_block_t *)pngle->allocator.alloc(pngle->allocator.ctx, sizeof(pngle_block_t) + bytes);
+	if (!block) {
+		debug_printf("[pngle] Failed to allocate %zd bytes for %s\n", bytes, name);
+		return NULL;
+	}
+	memset(block + 1, 0, bytes);
+	block->size = sizeof(pngle_block_t) + bytes;
+
+	pngle->mem_current += block->size;
+	if (pngle->mem_current > pngle->mem_peak) pngle->mem_peak = pngle->mem_current;
+
+	PNGLE_UNUSED(name);
+	return block + 1;
+}
+
+static void pngle_free(pngle_t *pngle, void *ptr)
+{
+	if (!ptr) return ;
+
+	pngle_block_t *block = (pngle_block_t *)ptr - 1;
+	pngle->mem_current -= block->size;
+	pngle->allocator.free(pngle->allocator.ctx, block);
+}
+
+// Reuse the buffer kept from a previous image (or pass) if it is large enough, replace it otherwise; zero-filled either way
+static void *pngle_reserve(pngle_t *pngle, void **ptr, size_t n, size_t size, const char *name)
+{
+	if (*ptr) {
+		size_t capacity = ((pngle_block_t *)*ptr - 1)->size - sizeof(pngle_block_t);
+		if (size == 0 || n <= capacity / size) {
+			memset(*ptr, 0, n * size);
+			return *ptr;
+		}
+	}
+
+	pngle_free(pngle, *ptr);
+	return *ptr = pngle_calloc(pngle, n, size, name);
+}
+
+static void *default_alloc(void *ctx, size_t size)
+{
+	PNGLE_UNUSED(ctx);
+	return malloc(size);
+}
+
+static void default_free(void *ctx, void *ptr)
+{
+	PNGLE_UNUSED(ctx);
+	free(ptr);
+}
+
 static inline uint16_t MAXVAL(pngle_t *pngle)
 {
 	uint8_t pixel_depth = (pngle->hdr.color_type & 1) ? 8 : pngle->hdr.depth;
@@ -175,36 +306,41 @@ void pngle_reset(pngle_t *pngle)
 	pngle->state = PNGLE_STATE_INITIAL;
 	pngle->error = "No error";
 
-	if (pngle->scanline_ringbuf) free(pngle->scanline_ringbuf);
-	if (pngle->palette) free(pngle->palette);
-	if (pngle->trans_palette) free(pngle->trans_palette);
-#ifndef PNGLE_NO_GAMMA_CORRECTION
-	if (pngle->gamma_table) free(pngle->gamma_table);
-#endif
-
-	pngle->scanline_ringbuf = NULL;
-	pngle->palette = NULL;
-	pngle->trans_palette = NULL;
-#ifndef PNGLE_NO_GAMMA_CORRECTION
-	pngle->gamma_table = NULL;
-#endif
-
+	// buffers are kept and reused by the next image; see pngle_destroy()
+	pngle->flags = 0;
 	pngle->channels = 0; // indicates IHDR hasn't been processed yet
 	pngle->next_out = NULL; // indicates IDAT hasn't been processed yet
+	pngle->lz_buf_size = 0;
+	pngle->lz_linear = 0;
+	pngle->lz_pending_len = 0;
+	pngle->suspended = 0;
+	pngle->palette_lut_format = -1;
+	pngle->mem_peak = pngle->mem_current;
 
 	// clear them just in case...
 	memset(&pngle->hdr, 0, sizeof(pngle->hdr));
 	pngle->n_palettes = 0;
 	pngle->n_trans_palettes = 0;
+	memset(pngle->background_color, 0, sizeof(pngle->background_color));
 
 	tinfl_init(&pngle->inflator);
 }
 
 pngle_t *pngle_new()
 {
-	pngle_t *pngle = (pngle_t *)PNGLE_CALLOC(1, sizeof(pngle_t), "pngle_t");
+	return pngle_new_with_allocator(NULL);
+}
+
+pngle_t *pngle_new_with_allocator(const pngle_allocator_t *allocator)
+{
+	static const pngle_allocator_t default_allocator = { default_alloc, default_free, NULL };
+	if (!allocator) allocator = &default_allocator;
+
+	pngle_t *pngle = (pngle_t *)allocator->alloc(allocator->ctx, sizeof(pngle_t));
 	if (!pngle) return NULL;
+	memset(pngle, 0, sizeof(pngle_t));
 
+	pngle->allocator = *allocator;
 	pngle_reset(pngle);
 
 	return pngle;
@@ -214,7 +350,22 @@ void pngle_destroy(pngle_t *pngle)
 {
 	if (pngle) {
 		pngle_reset(pngle);
-		free(pngle);
+
+		PNGLE_FREE(pngle->scanline_buf);
+		PNGLE_FREE(pngle->row_rgba);
+		PNGLE_FREE(pngle->scale_xtab);
+		PNGLE_FREE(pngle->scale_acc);
+		PNGLE_FREE(pngle->scale_row);
+		PNGLE_FREE(pngle->palette);
+		PNGLE_FREE(pngle->trans_palette);
+		PNGLE_FREE(pngle->palette_lut);
+		PNGLE_FREE(pngle->palette_lut_out);
+#ifndef PNGLE_NO_GAMMA_CORRECTION
+		PNGLE_FREE(pngle->gamma_table);
+#endif
+		PNGLE_FREE(pngle->lz_buf);
+
+		pngle->allocator.free(pngle->allocator.ctx, pngle);
 	}
 }
 
@@ -257,13 +408,7 @@ static int is_trans_color(pngle_t *pngle, uint16_t *value, size_t n)
 	return 1; // true
 }
 
-static inline void scanline_ringbuf_push(pngle_t *pngle, uint8_t value)
-{
-	pngle->scanline_ringbuf[pngle->scanline_ringbuf_cidx] = value;
-	pngle->scanline_ringbuf_cidx = (pngle->scanline_ringbuf_cidx + 1) % pngle->scanline_ringbuf_size;
-}
-
-static inline uint16_t read_pixel_value(const uint8_t *buf, size_t *ridx, int *bitcount, int depth, size_t buf_size)
+static inline uint16_t read_pixel_value(const uint8_t *buf, size_t *ridx, int *bitcount, int depth)
 {
 	uint16_t v;
 
@@ -274,7 +419,7 @@ static inline uint16_t read_pixel_value(const uint8_t *buf, size_t *ridx, int *b
 		{
 			if (*bitcount >= 8) {
 				*bitcount = 0;
-				*ridx = (*ridx + 1) % buf_size;
+				*ridx += 1;
 			}
 			*bitcount += depth;
 			const uint8_t mask = ((1UL << depth) - 1);
@@ -284,24 +429,20 @@ static inline uint16_t read_pixel_value(const uint8_t *buf, size_t *ridx, int *b
 
 	case 8:
 		v = buf[*ridx];
-		*ridx = (*ridx + 1) % buf_size;
+		*ridx += 1;
 		return v;
 
 	case 16:
-		v = buf[*ridx];
-		*ridx = (*ridx + 1) % buf_size;
-
-		v = v * 0x100 + buf[*ridx];
-		*ridx = (*ridx + 1) % buf_size;
+		v = buf[*ridx] * 0x100 + buf[*ridx + 1];
+		*ridx += 2;
 		return v;
 	}
 
 	return 0;
 }
 
-static const uint8_t *adjust_color(pngle_t *pngle, uint16_t v[4])
+static int adjust_color(pngle_t *pngle, uint16_t v[4], uint8_t rgba[4])
 {
-	static uint8_t rgba[4];
 	uint16_t maxval = MAXVAL(pngle);
 
 	if (pngle->hdr.color_type & 2) {
@@ -312,8 +453,7 @@ static const uint8_t *adjust_color(pngle_t *pngle, uint16_t v[4])
 			// lookup palette info
 			uint16_t pidx = v[0];
 			if (pidx >= pngle->n_palettes) {
-				(void)PNGLE_ERROR("Color index is out of range");
-				return NULL;
+				return PNGLE_ERROR("Color index is out of range");
 			}
 
 			v[0] = pngle->palette[pidx * 3 + 0];
@@ -340,26 +480,479 @@ static const uint8_t *adjust_color(pngle_t *pngle, uint16_t v[4])
 	rgba[3] = (v[3] * 255 + maxval / 2) / maxval;
 
 #ifndef PNGLE_NO_GAMMA_CORRECTION
-	if (pngle->gamma_table) {
+	if (pngle->flags & PNGLE_FLAG_GAMMA) {
 		for (int i = 0; i < 3; i++) {
 			rgba[i] = pngle->gamma_table[v[i]];
 		}
 	}
 #endif
 
-	return rgba;
+	return 0;
+}
+
+// composites a pixel over the matte, rounding (c * a + m * (255 - a)) / 255
+static inline void flatten_pixel(const uint8_t matte[3], uint8_t rgba[4])
+{
+	uint_fast16_t a = rgba[3];
+	if (a == 0xff) return ;
+
+	for (int i = 0; i < 3; i++) {
+		uint_fast32_t t = rgba[i] * a + matte[i] * (0xff - a) + 0x80;
+		rgba[i] = (t + (t >> 8)) >> 8;
+	}
+	rgba[3] = 0xff;
+}
+
+static void flatten_row(const uint8_t matte[3], uint8_t *rgba, size_t n)
+{
+	for (size_t i = 0; i < n; i++, rgba += 4) flatten_pixel(matte, rgba);
+}
+
+static void setup_flatten(pngle_t *pngle)
+{
+	pngle->flattening = pngle->flatten != PNGLE_FLATTEN_NONE && ((pngle->hdr.color_type & 4) || (pngle->flags & PNGLE_FLAG_tRNS));
+
+	if (pngle->flatten == PNGLE_FLATTEN_BKGD && (pngle->flags & PNGLE_FLAG_bKGD)) {
+		memcpy(pngle->matte, pngle->background_color, 3);
+	} else {
+		memcpy(pngle->matte, pngle->flatten_color, 3);
+	}
+}
+
+static inline void pack_pixel(pngle_pixel_format_t format, uint8_t *p, const uint8_t rgba[4])
+{
+	uint16_t c;
+
+	switch (format) {
+	case PNGLE_PIXEL_FORMAT_RGBA8888:
+		memcpy(p, rgba, 4);
+		break;
+
+	case PNGLE_PIXEL_FORMAT_RGB565:
+		c = ((rgba[0] & 0xf8) << 8) | ((rgba[1] & 0xfc) << 3) | (rgba[2] >> 3);
+		memcpy(p, &c, 2);
+		break;
+
+	case PNGLE_PIXEL_FORMAT_RGB565_SWAP:
+		c = ((rgba[0] & 0xf8) << 8) | ((rgba[1] & 0xfc) << 3) | (rgba[2] >> 3);
+		p[0] = c >> 8;
+		p[1] = c & 0xff;
+		break;
+	}
+}
+
+static inline void pngle_put_pixel(pngle_t *pngle, uint32_t x, uint32_t y, const uint8_t rgba[4])
+{
+	if (x >= pngle->out_width || y >= pngle->out_height) return; // clip
+
+	size_t bpp = pngle->out_format == PNGLE_PIXEL_FORMAT_RGBA8888 ? 4 : 2;
+	pack_pixel(pngle->out_format, pngle->out_buf + (size_t)y * pngle->out_stride + x * bpp, rgba);
+}
+
+static void pngle_fill_block(pngle_t *pngle, uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint8_t rgba[4])
+{
+	if (x >= pngle->out_width || y >= pngle->out_height) return; // clip
+	w = MIN(w, pngle->out_width - x);
+	h = MIN(h, pngle->out_height - y);
+
+	size_t bpp = pngle->out_format == PNGLE_PIXEL_FORMAT_RGBA8888 ? 4 : 2;
+	uint8_t px[4];
+	pack_pixel(pngle->out_format, px, rgba);
+
+	for (uint32_t j = 0; j < h; j++) {
+		uint8_t *p = pngle->out_buf + (size_t)(y + j) * pngle->out_stride + x * bpp;
+		for (uint32_t i = 0; i < w; i++, p += bpp) memcpy(p, px, bpp);
+	}
+}
+
+// rows of the current pass can go straight into the output buffer (no scaling, no blocks to fill)
+static inline int pngle_direct_output(pngle_t *pngle)
+{
+	if (!pngle->out_buf || pngle->scale_w) return 0;
+	return !pngle->progressive || pngle->interlace_pass == 0 || pngle->interlace_pass == 7;
+}
+
+// n pixels at (x0 + i * dx, y); bw x bh is the block each pixel stands for, clipped to width
+static void pngle_emit_row(pngle_t *pngle, uint32_t x0, uint32_t y, uint32_t dx, uint32_t n, const uint8_t *rgba, uint32_t width, uint32_t bw, uint32_t bh)
+{
+	if (pngle->out_buf) {
+		for (uint32_t i = 0, x = x0; i < n; i++, x += dx, rgba += 4) {
+			if (pngle->progressive) {
+				pngle_fill_block(pngle, x, y, MIN(bw, width - x), bh, rgba);
+			} else {
+				pngle_put_pixel(pngle, x, y, rgba);
+			}
+		}
+		return ;
+	}
+
+	if (pngle->row_callback) {
+		pngle->row_callback(pngle, x0, y, dx, n, rgba);
+	}
+
+	// per-pixel interface, built on top of the row
+	if (pngle->draw_callback) {
+		for (uint32_t i = 0, x = x0; i < n; i++, x += dx, rgba += 4) {
+			pngle->draw_callback(pngle, x, y, MIN(bw, width - x), bh, rgba);
+		}
+	}
+}
+
+static void pngle_draw_row(pngle_t *pngle)
+{
+	uint32_t x0 = interlace_off_x[pngle->interlace_pass];
+	uint32_t dx = interlace_div_x[pngle->interlace_pass];
+	uint32_t y  = pngle->drawing_y;
+	uint32_t bw = interlace_div_x[pngle->interlace_pass] - interlace_off_x[pngle->interlace_pass];
+	uint32_t bh = MIN(interlace_div_y[pngle->interlace_pass] - interlace_off_y[pngle->interlace_pass], pngle->hdr.height - y);
+
+	pngle_emit_row(pngle, x0, y, dx, pngle->row_pixels, pngle->row_rgba, pngle->hdr.width, bw, bh);
+}
+
+// source row of the output row y (nearest, sampled at the pixel center)
+static inline uint32_t scale_src_y(pngle_t *pngle, uint32_t y)
+{
+	return pngle->src_y + (uint32_t)(((2 * (uint64_t)y + 1) * pngle->src_h) / (2 * pngle->scale_h));
+}
+
+static int setup_scaling(pngle_t *pngle)
+{
+	uint32_t w = pngle->hdr.width;
+	uint32_t h = pngle->hdr.height;
+
+	pngle->src_x = pngle->crop_x;
+	pngle->src_y = pngle->crop_y;
+	pngle->src_w = pngle->crop_w;
+	pngle->src_h = pngle->crop_h;
+	pngle->src_filter = pngle->scale_filter;
+
+	if (pngle->src_w == 0 || pngle->src_h == 0) {
+		// center crop to the aspect ratio of the output (at least one pixel, e.g. a 1x1 image to 16:9)
+		if ((uint64_t)w * pngle->scale_h > (uint64_t)h * pngle->scale_w) {
+			pngle->src_h = h;
+			pngle->src_w = MAX(1, MIN(w, (uint32_t)((uint64_t)h * pngle->scale_w / pngle->scale_h)));
+		} else {
+			pngle->src_w = w;
+			pngle->src_h = MAX(1, MIN(h, (uint32_t)((uint64_t)w * pngle->scale_h / pngle->scale_w)));
+		}
+		pngle->src_x = (w - pngle->src_w) / 2;
+		pngle->src_y = (h - pngle->src_h) / 2;
+	}
+
+	if (pngle->src_x >= w || pngle->src_y >= h) return PNGLE_ERROR("Crop rectangle is out of the image");
+	pngle->src_w = MIN(pngle->src_w, w - pngle->src_x);
+	pngle->src_h = MIN(pngle->src_h, h - pngle->src_y);
+	if (pngle->src_w == 0 || pngle->src_h == 0) return PNGLE_ERROR("Empty crop rectangle");
+
+	// box filter only makes sense for downscaling rows delivered in order
+	if (pngle->hdr.interlace || pngle->scale_w > pngle->src_w || pngle->scale_h > pngle->src_h) pngle->src_filter = PNGLE_SCALE_NEAREST;
+
+	if (pngle->hdr.interlace && !pngle->out_buf) return PNGLE_ERROR("Scaling interlaced images requires an output buffer");
+
+	debug_printf("[pngle] scaling (%u, %u)-%ux%u to %ux%u, filter %d\n", pngle->src_x, pngle->src_y, pngle->src_w, pngle->src_h, pngle->scale_w, pngle->scale_h, pngle->src_filter);
+
+	if (!PNGLE_RESERVE(pngle->scale_xtab, pngle->scale_w, sizeof(uint32_t), "scale table")) return PNGLE_ERROR("Insufficient memory");
+	if (!PNGLE_RESERVE(pngle->scale_row, pngle->scale_w, 4, "scale row")) return PNGLE_ERROR("Insufficient memory");
+
+	if (pngle->src_filter == PNGLE_SCALE_BOX) {
+		if (!PNGLE_RESERVE(pngle->scale_acc, pngle->scale_w, 4 * sizeof(uint32_t), "scale accumulator")) return PNGLE_ERROR("Insufficient memory");
+		for (uint32_t x = 0; x < pngle->src_w; x++) {
+			pngle->scale_xtab[(uint64_t)x * pngle->scale_w / pngle->src_w]++;
+		}
+		pngle->scale_acc_y = 0;
+		pngle->scale_acc_rows = 0;
+	} else {
+		for (uint32_t x = 0; x < pngle->scale_w; x++) {
+			pngle->scale_xtab[x] = pngle->src_x + (uint32_t)(((2 * (uint64_t)x + 1) * pngle->src_w) / (2 * pngle->scale_w));
+		}
+	}
+
+	return 0;
+}
+
+static void scale_flush_box(pngle_t *pngle)
+{
+	uint32_t *acc = pngle->scale_acc;
+	uint8_t *out = pngle->scale_row;
+
+	for (uint32_t x = 0; x < pngle->scale_w; x++, acc += 4, out += 4) {
+		uint32_t n = pngle->scale_xtab[x] * pngle->scale_acc_rows;
+		for (int c = 0; c < 4; c++) {
+			out[c] = (acc[c] + n / 2) / n;
+			acc[c] = 0;
+		}
+	}
+
+	pngle_emit_row(pngle, 0, pngle->scale_acc_y, 1, pngle->scale_w, pngle->scale_row, pngle->scale_w, 1, 1);
+	pngle->scale_acc_rows = 0;
+}
+
+static void pngle_scale_row(pngle_t *pngle)
+{
+	uint32_t sy = pngle->drawing_y;
+	uint32_t x0 = interlace_off_x[pngle->interlace_pass];
+	uint32_t dx = interlace_div_x[pngle->interlace_pass];
+
+	// source block each pixel of the row fills (progressive interlace passes)
+	uint32_t bw = 1;
+	uint32_t bh = 1;
+	if (pngle->progressive && pngle->interlace_pass) {
+		bw = interlace_div_x[pngle->interlace_pass] - interlace_off_x[pngle->interlace_pass];
+		bh = interlace_div_y[pngle->interlace_pass] - interlace_off_y[pngle->interlace_pass];
+	}
+
+	if (sy < pngle->src_y || sy >= pngle->src_y + pngle->src_h) return;
+
+	if (pngle->src_filter == PNGLE_SCALE_BOX) {
+		// rows arrive in order; non-interlaced only
+		uint32_t y = (uint64_t)(sy - pngle->src_y) * pngle->scale_h / pngle->src_h;
+		if (pngle->scale_acc_rows > 0 && y != pngle->scale_acc_y) scale_flush_box(pngle);
+		pngle->scale_acc_y = y;
+
+		const uint8_t *in = pngle->row_rgba + (size_t)pngle->src_x * 4;
+		uint32_t *acc = pngle->scale_acc;
+		uint32_t err = 0;
+		for (uint32_t x = 0; x < pngle->src_w; x++, in += 4) {
+			acc[0] += in[0];
+			acc[1] += in[1];
+			acc[2] += in[2];
+			acc[3] += in[3];
+			if ((err += pngle->scale_w) >= pngle->src_w) {
+				err -= pngle->src_w;
+				acc += 4;
+			}
+		}
+		pngle->scale_acc_rows++;
+
+		if (sy == pngle->src_y + pngle->src_h - 1) scale_flush_box(pngle);
+		return ;
+	}
+
+	// nearest: output rows sampling this source row (at least one row lower than the first hit)
+	uint32_t y = (uint64_t)(sy - pngle->src_y) * pngle->scale_h / pngle->src_h;
+	if (y > 0) y--;
+
+	for (; y < pngle->scale_h; y++) {
+		uint32_t ty = scale_src_y(pngle, y);
+		if (ty < sy) continue;
+		if (ty - sy >= bh) break;
+
+		if (dx == 1) {
+			uint8_t *out = pngle->scale_row;
+			for (uint32_t x = 0; x < pngle->scale_w; x++, out += 4) {
+				memcpy(out, pngle->row_rgba + (size_t)pngle->scale_xtab[x] * 4, 4);
+			}
+			pngle_emit_row(pngle, 0, y, 1, pngle->scale_w, pngle->scale_row, pngle->scale_w, 1, 1);
+			continue;
+		}
+
+		// interlace pass row: only the columns sampling a pixel of this pass (output buffer only)
+		for (uint32_t x = 0; x < pngle->scale_w; x++) {
+			uint32_t tx = pngle->scale_xtab[x];
+			if (tx < x0 || (tx - x0) % dx >= bw) continue;
+			pngle_put_pixel(pngle, x, y, pngle->row_rgba + (size_t)((tx - x0) / dx) * 4);
+		}
+	}
+}
+
+// the row is complete; hand it over at once
+static int pngle_draw_row_done(pngle_t *pngle)
+{
+	if (pngle->scale_w) {
+		pngle_scale_row(pngle);
+	} else if (!pngle_direct_output(pngle)) {
+		pngle_draw_row(pngle);
+	}
+
+	// last row of an interlace pass
+	uint_fast8_t pass = pngle->interlace_pass;
+	if (pass && pngle->pass_callback && pngle->hdr.height - pngle->drawing_y <= interlace_div_y[pass]) {
+		pngle->pass_callback(pngle, pass);
+	}
+
+	return 0;
+}
+
+static int setup_palette_lut(pngle_t *pngle)
+{
+	if (!PNGLE_RESERVE(pngle->palette_lut, 256, 4, "palette LUT")) return PNGLE_ERROR("Insufficient memory");
+
+	for (size_t i = 0; i < pngle->n_palettes; i++) {
+		uint16_t v[4] = { (uint16_t)i };
+		if (adjust_color(pngle, v, pngle->palette_lut + i * 4) < 0) return -1;
+		if (pngle->flattening) flatten_pixel(pngle->matte, pngle->palette_lut + i * 4);
+	}
+	pngle->palette_lut_format = -1;
+
+	return 0;
+}
+
+static int setup_palette_lut_out(pngle_t *pngle)
+{
+	if (!PNGLE_RESERVE(pngle->palette_lut_out, 256, 2, "palette output LUT")) return PNGLE_ERROR("Insufficient memory");
+
+	for (size_t i = 0; i < pngle->n_palettes; i++) {
+		pack_pixel(pngle->out_format, pngle->palette_lut_out + i * 2, pngle->palette_lut + i * 4);
+	}
+	pngle->palette_lut_format = pngle->out_format;
+
+	return 0;
+}
+
+// color type 3: a single table load per pixel, with one loop per index depth and LUT entry size
+#define PNGLE_INDEXED_LOOP(INDEX, BPP) \
+	for (size_t i = 0; i < n; i++, dst += dst_step) { \
+		uint_fast8_t idx = (INDEX); \
+		if (idx >= n_palettes) return PNGLE_ERROR("Color index is out of range"); \
+		memcpy(dst, lut + idx * (BPP), (BPP)); \
+	}
+
+#define PNGLE_INDEXED_ROW(BPP) \
+	switch (depth) { \
+	case 8: PNGLE_INDEXED_LOOP(p[i], BPP); break; \
+	case 4: PNGLE_INDEXED_LOOP((p[i >> 1] >> ((~i & 1) << 2)) & 0x0f, BPP); break; \
+	default: PNGLE_INDEXED_LOOP((p[(i * depth) >> 3] >> (8 - depth - ((i * depth) & 7))) & mask, BPP); break; \
+	}
+
+static int pngle_draw_indexed(pngle_t *pngle)
+{
+	const uint8_t *p = pngle->scanline_cur;
+	uint_fast8_t depth = pngle->hdr.depth;
+	uint_fast8_t mask = (1U << depth) - 1;
+	size_t n = pngle->row_pixels;
+	uint32_t x = pngle->drawing_x;
+	uint32_t dx = interlace_div_x[pngle->interlace_pass];
+
+	pngle->drawing_x = pngle->hdr.width;
+
+	const uint8_t *lut = pngle->palette_lut;
+	size_t bpp = 4;
+	uint8_t *dst = pngle->row_rgba;
+	size_t dst_step = 4;
+
+	if (pngle_direct_output(pngle)) {
+		// write straight into the caller's buffer, no row stage
+		uint32_t y = pngle->drawing_y;
+		if (y >= pngle->out_height || x >= pngle->out_width) return 0; // clipped
+		n = MIN(n, (pngle->out_width - x + dx - 1) / dx);
+
+		if (pngle->out_format != PNGLE_PIXEL_FORMAT_RGBA8888) {
+			if (pngle->palette_lut_format != (int_fast8_t)pngle->out_format && setup_palette_lut_out(pngle) < 0) return -1;
+			lut = pngle->palette_lut_out;
+			bpp = 2;
+		}
+		dst = pngle->out_buf + (size_t)y * pngle->out_stride + x * bpp;
+		dst_step = bpp * dx;
+	}
+
+	size_t n_palettes = pngle->n_palettes;
+	if (bpp == 2) {
+		PNGLE_INDEXED_ROW(2);
+	} else {
+		PNGLE_INDEXED_ROW(4);
+	}
+
+	return 0;
+}
+
+#undef PNGLE_INDEXED_ROW
+#undef PNGLE_INDEXED_LOOP
+
+// 8-bit color types without tRNS or gamma: whole rows at once
+static void convert_row_gray8(const uint8_t *src, uint8_t *rgba, size_t n)
+{
+	for (size_t i = 0; i < n; i++, rgba += 4) {
+		rgba[0] = rgba[1] = rgba[2] = src[i];
+		rgba[3] = 0xff;
+	}
+}
+
+static void convert_row_rgb8(const uint8_t *src, uint8_t *rgba, size_t n)
+{
+	for (size_t i = 0; i < n; i++, src += 3, rgba += 4) {
+		rgba[0] = src[0];
+		rgba[1] = src[1];
+		rgba[2] = src[2];
+		rgba[3] = 0xff;
+	}
+}
+
+static void convert_row_rgba8(const uint8_t *src, uint8_t *rgba, size_t n)
+{
+	memcpy(rgba, src, n * 4);
+}
+
+static void setup_row_converter(pngle_t *pngle)
+{
+	pngle->convert_row = NULL;
+
+	if (pngle->hdr.depth != 8) return ;
+	if (pngle->flags & PNGLE_FLAG_tRNS) return ; // transparent color key
+#ifndef PNGLE_NO_GAMMA_CORRECTION
+	if (pngle->flags & PNGLE_FLAG_GAMMA) return ;
+#endif
+
+	switch (pngle->hdr.color_type) {
+	case 0: pngle->convert_row = convert_row_gray8; break;
+	case 2: pngle->convert_row = convert_row_rgb8; break;
+	case 6: pngle->convert_row = convert_row_rgba8; break;
+	}
+}
+
+static void pngle_draw_converted(pngle_t *pngle)
+{
+	size_t n = pngle->row_pixels;
+	uint32_t x = pngle->drawing_x;
+	uint32_t dx = interlace_div_x[pngle->interlace_pass];
+
+	pngle->drawing_x = pngle->hdr.width;
+
+	if (!pngle_direct_output(pngle)) {
+		pngle->convert_row(pngle->scanline_cur, pngle->row_rgba, n);
+		if (pngle->flattening) flatten_row(pngle->matte, pngle->row_rgba, n);
+		return ;
+	}
+
+	// write straight into the caller's buffer
+	uint32_t y = pngle->drawing_y;
+	if (y >= pngle->out_height || x >= pngle->out_width) return ; // clipped
+	n = MIN(n, (pngle->out_width - x + dx - 1) / dx);
+
+	size_t bpp = pngle->out_format == PNGLE_PIXEL_FORMAT_RGBA8888 ? 4 : 2;
+	uint8_t *dst = pngle->out_buf + (size_t)y * pngle->out_stride + x * bpp;
+
+	if (bpp == 4 && dx == 1) {
+		pngle->convert_row(pngle->scanline_cur, dst, n);
+		if (pngle->flattening) flatten_row(pngle->matte, dst, n);
+		return ;
+	}
+
+	pngle->convert_row(pngle->scanline_cur, pngle->row_rgba, n);
+	if (pngle->flattening) flatten_row(pngle->matte, pngle->row_rgba, n);
+	for (size_t i = 0; i < n; i++, dst += bpp * dx) {
+		pack_pixel(pngle->out_format, dst, pngle->row_rgba + i * 4);
+	}
 }
 
-static int pngle_draw_pixels(pngle_t *pngle, size_t scanline_ringbuf_xidx)
+static int pngle_draw_pixels(pngle_t *pngle)
 {
+	if (pngle->hdr.color_type == 3) {
+		if (pngle_draw_indexed(pngle) < 0) return -1;
+		return pngle_draw_row_done(pngle);
+	}
+
+	if (pngle->convert_row) {
+		pngle_draw_converted(pngle);
+		return pngle_draw_row_done(pngle);
+	}
+
 	uint16_t v[4]; // MAX_CHANNELS
+	size_t ridx = 0;
 	int bitcount = 0;
 
-	int n_pixels = pngle->hdr.depth == 16 ? 1 : (8 / pngle->hdr.depth);
-
-	for (; n_pixels-- > 0 && pngle->drawing_x < pngle->hdr.width; pngle->drawing_x = U32_CLAMP_ADD(pngle->drawing_x, interlace_div_x[pngle->interlace_pass], pngle->hdr.width)) {
+	for (; pngle->drawing_x < pngle->hdr.width; pngle->drawing_x = U32_CLAMP_ADD(pngle->drawing_x, interlace_div_x[pngle->interlace_pass], pngle->hdr.width)) {
 		for (uint_fast8_t c = 0; c < pngle->channels; c++) {
-			v[c] = read_pixel_value(pngle->scanline_ringbuf, &scanline_ringbuf_xidx, &bitcount, pngle->hdr.depth, pngle->scanline_ringbuf_size);
+			v[c] = read_pixel_value(pngle->scanline_cur, &ridx, &bitcount, pngle->hdr.depth);
 		}
 
 		// color type: 0000 0111
@@ -367,19 +960,21 @@ static int pngle_draw_pixels(pngle_t *pngle, size_t scanline_ringbuf_xidx)
 		//                    ^--- Color
 		//                   ^---- Alpha channel
 
-		const uint8_t *rgba = adjust_color(pngle, v);
-		if (!rgba) return -1;
-
-		if (pngle->draw_callback) {
-			pngle->draw_callback(pngle, pngle->drawing_x, pngle->drawing_y
-				, MIN(interlace_div_x[pngle->interlace_pass] - interlace_off_x[pngle->interlace_pass], pngle->hdr.width  - pngle->drawing_x)
-				, MIN(interlace_div_y[pngle->interlace_pass] - interlace_off_y[pngle->interlace_pass], pngle->hdr.height - pngle->drawing_y)
-				, rgba
-			);
+		if (pngle_direct_output(pngle)) {
+			// write straight into the caller's buffer, no row stage
+			uint8_t rgba[4];
+			if (adjust_color(pngle, v, rgba) < 0) return -1;
+			if (pngle->flattening) flatten_pixel(pngle->matte, rgba);
+			pngle_put_pixel(pngle, pngle->drawing_x, pngle->drawing_y, rgba);
+			continue;
 		}
+
+		size_t i = (pngle->drawing_x - interlace_off_x[pngle->interlace_pass]) / interlace_div_x[pngle->interlace_pass];
+		if (adjust_color(pngle, v, pngle->row_rgba + i * 4) < 0) return -1;
+		if (pngle->flattening) flatten_pixel(pngle->matte, pngle->row_rgba + i * 4);
 	}
 
-	return 0;
+	return pngle_draw_row_done(pngle);
 }
 
 static inline int paeth(int a, int b, int c)
@@ -394,41 +989,136 @@ static inline int paeth(int a, int b, int c)
 	return c;
 }
 
+// Per-byte lane arithmetic on 32-bit words without carries across lanes
+#define SWAR_ADD(a, b) ((((a) & 0x7f7f7f7fUL) + ((b) & 0x7f7f7f7fUL)) ^ (((a) ^ (b)) & 0x80808080UL))
+#define SWAR_AVG(a, b) (((a) & (b)) + ((((a) ^ (b)) >> 1) & 0x7f7f7f7fUL)) // floor((a + b) / 2)
+
+static inline uint32_t load_word(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, __builtin_assume_aligned(p, 4), 4);
+	return v;
+}
+
+static inline void store_word(uint8_t *p, uint32_t v)
+{
+	memcpy(__builtin_assume_aligned(p, 4), &v, 4);
+}
+
+// Reverse the filter of a whole row in place.
+// Both rows are word aligned, padded to a multiple of 4 bytes and preceded by SCANLINE_LEAD zero bytes,
+// so that a (left) and c (left-up) of the first pixel read zeros without a branch.
+static void unfilter_row(uint8_t *cur, const uint8_t *prev, size_t stride, size_t bpp, int filter_type)
+{
+	size_t i;
+	size_t words = (stride + 3) / 4;
+	size_t wbpp = bpp / 4; // pixel distance in words when pixels are word sized
+
+	switch (filter_type) {
+	case 0: // None
+		break;
+
+	case 1: // Sub
+		if (bpp % 4 == 0) {
+			for (i = 0; i < words; i++) {
+				store_word(cur + i * 4, SWAR_ADD(load_word(cur + i * 4), load_word(cur + (i - wbpp) * 4)));
+			}
+		} else {
+			for (i = 0; i < stride; i++) {
+				cur[i] += cur[i - bpp];
+			}
+		}
+		break;
+
+	case 2: // Up
+		for (i = 0; i < words; i++) {
+			store_word(cur + i * 4, SWAR_ADD(load_word(cur + i * 4), load_word(prev + i * 4)));
+		}
+		break;
+
+	case 3: // Average
+		if (bpp % 4 == 0) {
+			for (i = 0; i < words; i++) {
+				uint32_t a = load_word(cur + (i - wbpp) * 4);
+				uint32_t b = load_word(prev + i * 4);
+				store_word(cur + i * 4, SWAR_ADD(load_word(cur + i * 4), SWAR_AVG(a, b)));
+			}
+		} else {
+			for (i = 0; i < stride; i++) {
+				cur[i] += (cur[i - bpp] + prev[i]) >> 1;
+			}
+		}
+		break;
+
+	case 4: // Paeth
+		for (i = 0; i < stride; i++) {
+			cur[i] += paeth(cur[i - bpp], prev[i], prev[i - bpp]);
+		}
+		break;
+	}
+}
+
 static int set_interlace_pass(pngle_t *pngle, uint_fast8_t pass)
 {
 	pngle->interlace_pass = pass;
 
-	uint_fast8_t bytes_per_pixel = (pngle->channels * pngle->hdr.depth + 7) / 8; // 1 if depth <= 8
 	size_t scanline_pixels = (pngle->hdr.width - interlace_off_x[pngle->interlace_pass] + interlace_div_x[pngle->interlace_pass] - 1) / interlace_div_x[pngle->interlace_pass];
 	size_t scanline_stride = (scanline_pixels * pngle->channels * pngle->hdr.depth + 7) / 8;
 
-	pngle->scanline_ringbuf_size = scanline_stride + bytes_per_pixel * 2; // 2 rooms for c/x and a
+	// sized for a full-width row, so every pass (and the next image, if it is not wider) reuses the same buffers
+	size_t full_stride = ((size_t)pngle->hdr.width * pngle->channels * pngle->hdr.depth + 7) / 8;
+	size_t row_size = SCANLINE_LEAD + ((full_stride + 3) & ~(size_t)3);
+
+	if (!PNGLE_RESERVE(pngle->scanline_buf, row_size, 2, "scanline buffer")) return PNGLE_ERROR("Insufficient memory");
+
+	// previous row reads zeros on the first row of the pass
+	pngle->scanline_prev = pngle->scanline_buf + SCANLINE_LEAD;
+	pngle->scanline_cur  = pngle->scanline_buf + row_size + SCANLINE_LEAD;
+	pngle->scanline_stride = scanline_stride;
 
-	if (pngle->scanline_ringbuf) free(pngle->scanline_ringbuf);
-	if ((pngle->scanline_ringbuf = (uint8_t *)PNGLE_CALLOC(pngle->scanline_ringbuf_size, 1, "scanline ringbuf")) == NULL) return PNGLE_ERROR("Insufficient memory");
+	pngle->row_pixels = scanline_pixels;
+
+	if (!PNGLE_RESERVE(pngle->row_rgba, pngle->hdr.width ? pngle->hdr.width : 1, 4, "row buffer")) return PNGLE_ERROR("Insufficient memory");
 
 	pngle->drawing_x = interlace_off_x[pngle->interlace_pass];
 	pngle->drawing_y = interlace_off_y[pngle->interlace_pass];
 	pngle->filter_type = -1;
 
-	pngle->scanline_ringbuf_cidx = 0;
-	pngle->scanline_remain_bytes_to_render = -1;
+	pngle->scanline_filled = 0;
 
 	return 0;
 }
 
+// size of the inflated IDAT stream: the filtered rows of every (non-empty) pass, each with its filter type byte
+static uint64_t image_data_size(pngle_t *pngle)
+{
+	uint64_t size = 0;
+	uint_fast8_t first = pngle->hdr.interlace ? 1 : 0;
+	uint_fast8_t last = pngle->hdr.interlace ? 7 : 0;
+
+	for (uint_fast8_t pass = first; pass <= last; pass++) {
+		if (pngle->hdr.width <= interlace_off_x[pass] || pngle->hdr.height <= interlace_off_y[pass]) continue; // empty pass
+
+		uint64_t pixels = (pngle->hdr.width - interlace_off_x[pass] + interlace_div_x[pass] - 1) / interlace_div_x[pass];
+		uint64_t rows = (pngle->hdr.height - interlace_off_y[pass] + interlace_div_y[pass] - 1) / interlace_div_y[pass];
+		size += rows * (1 + (pixels * pngle->channels * pngle->hdr.depth + 7) / 8);
+	}
+
+	return size;
+}
+
 static int setup_gamma_table(pngle_t *pngle, uint32_t png_gamma)
 {
 #ifndef PNGLE_NO_GAMMA_CORRECTION
-	if (pngle->gamma_table) free(pngle->gamma_table);
+	pngle->flags &= ~PNGLE_FLAG_GAMMA;
 
 	if (pngle->display_gamma <= 0) return 0; // disable gamma correction
 	if (png_gamma == 0) return 0;
 
 	uint16_t maxval = MAXVAL(pngle);
 
-	pngle->gamma_table = (uint8_t *)PNGLE_CALLOC(1, maxval + 1, "gamma table");
-	if (!pngle->gamma_table) return PNGLE_ERROR("Insufficient memory");
+	if (!PNGLE_RESERVE(pngle->gamma_table, 1, maxval + 1, "gamma table")) return PNGLE_ERROR("Insufficient memory");
+	pngle->flags |= PNGLE_FLAG_GAMMA;
 
 	for (int i = 0; i < maxval + 1; i++) {
 		pngle->gamma_table[i] = (uint8_t)floor(pow(i / (double)maxval, 100000.0 / png_gamma / pngle->display_gamma) * 255.0 + 0.5);
@@ -442,8 +1132,10 @@ static int setup_gamma_table(pngle_t *pngle, uint32_t png_gamma)
 }
 
 
+// returns the number of bytes consumed (less than len only if suspended), or -1 on error
 static int pngle_on_data(pngle_t *pngle, const uint8_t *p, int len)
 {
+	const uint8_t *sp = p;
 	const uint8_t *ep = p + len;
 
 	uint_fast8_t bytes_per_pixel = (pngle->channels * pngle->hdr.depth + 7) / 8; // 1 if depth <= 8
@@ -473,50 +1165,54 @@ static int pngle_on_data(pngle_t *pngle, const uint8_t *p, int len)
 			}
 
 			pngle->filter_type = (int_fast8_t)*p++; // 0 - 4
-
-			// push sentinel bytes for new line
-			for (uint_fast8_t i = 0; i < bytes_per_pixel; i++) {
-				scanline_ringbuf_push(pngle, 0);
-			}
-
 			continue;
 		}
 
-		size_t cidx =  pngle->scanline_ringbuf_cidx;
-		size_t bidx = (pngle->scanline_ringbuf_cidx                                + bytes_per_pixel) % pngle->scanline_ringbuf_size;
-		size_t aidx = (pngle->scanline_ringbuf_cidx + pngle->scanline_ringbuf_size - bytes_per_pixel) % pngle->scanline_ringbuf_size;
-		// debug_printf("[pngle] cidx = %zd, bidx = %zd, aidx = %zd\n", cidx, bidx, aidx);
-
-		uint8_t c = pngle->scanline_ringbuf[cidx]; // left-up
-		uint8_t b = pngle->scanline_ringbuf[bidx]; // up
-		uint8_t a = pngle->scanline_ringbuf[aidx]; // left
-		uint8_t x = *p++; // target
-		// debug_printf("[pngle] c = 0x%02x, b = 0x%02x, a = 0x%02x, x = 0x%02x\n", c, b, a, x);
-
-		// Reverse the filter
-		switch (pngle->filter_type) {
-		case 0: break; // None
-		case 1: x += a; break; // Sub
-		case 2: x += b; break; // Up
-		case 3: x += (a + b) / 2; break; // Average
-		case 4: x += paeth(a, b, c); break; // Paeth
-		}
+		// gather the filtered row
+		size_t n = MIN((size_t)(ep - p), pngle->scanline_stride - pngle->scanline_filled);
+		memcpy(pngle->scanline_cur + pngle->scanline_filled, p, n);
+		pngle->scanline_filled += n;
+		p += n;
 
-		scanline_ringbuf_push(pngle, x); // updates scanline_ringbuf_cidx
+		if (pngle->scanline_filled < pngle->scanline_stride) continue; // need more data
 
-		if (pngle->scanline_remain_bytes_to_render < 0) pngle->scanline_remain_bytes_to_render = bytes_per_pixel;
-		if (--pngle->scanline_remain_bytes_to_render == 0) {
-			size_t xidx = (pngle->scanline_ringbuf_cidx + pngle->scanline_ringbuf_size - bytes_per_pixel) % pngle->scanline_ringbuf_size;
+		// Reverse the filter, then render the whole row
+		unfilter_row(pngle->scanline_cur, pngle->scanline_prev, pngle->scanline_stride, bytes_per_pixel, pngle->filter_type);
+		if (pngle_draw_pixels(pngle) < 0) return -1;
 
-			if (pngle_draw_pixels(pngle, xidx) < 0) return -1;
+		// current row becomes the previous one
+		uint8_t *tmp = pngle->scanline_prev;
+		pngle->scanline_prev = pngle->scanline_cur;
+		pngle->scanline_cur = tmp;
+		pngle->scanline_filled = 0;
 
-			pngle->scanline_remain_bytes_to_render = -1; // reset
-		}
+		if (pngle->suspended) return p - sp;
 	}
 
 	return len;
 }
 
+// Hands the pending inflated bytes to the scanline decoder and rewinds the LZ window once it is full and all of them are taken
+static int pngle_flush_lz(pngle_t *pngle)
+{
+	if (pngle->lz_pending_len == 0) return 0;
+
+	int n = pngle_on_data(pngle, pngle->lz_pending, pngle->lz_pending_len);
+	if (n < 0) return -1;
+
+	pngle->lz_pending += n;
+	pngle->lz_pending_len -= n;
+	if (pngle->lz_pending_len > 0) return 0; // suspended; resumed by the next pngle_feed()
+
+	// XXX: tinfl_decompress always requires (next_out - lz_buf + avail_out) == lz_buf_size
+	if (pngle->avail_out == 0 && !pngle->lz_linear) {
+		pngle->next_out = pngle->lz_buf;
+		pngle->avail_out = pngle->lz_buf_size;
+	}
+
+	return 0;
+}
+
 
 static int pngle_handle_chunk(pngle_t *pngle, const uint8_t *buf, size_t len)
 {
@@ -593,13 +1289,21 @@ static int pngle_handle_chunk(pngle_t *pngle, const uint8_t *buf, size_t len)
 
 			debug_printf("[pngle]   Reading IDAT (len %zd / chunk remain %u)\n", len, pngle->chunk_remain);
 
+			if (pngle->lz_linear && pngle->avail_out == 0) {
+				// every row is in; excess data is ignored, as the scanline decoder does with a window
+				consume = len;
+				break;
+			}
+
 			size_t in_bytes  = len;
 			size_t out_bytes = pngle->avail_out;
 
 			//debug_printf("[pngle]     in_bytes %zd, out_bytes %zd, next_out %p\n", in_bytes, out_bytes, pngle->next_out);
 
-			// XXX: tinfl_decompress always requires (next_out - lz_buf + avail_out) == TINFL_LZ_DICT_SIZE
-			tinfl_status status = tinfl_decompress(&pngle->inflator, (const mz_uint8 *)buf, &in_bytes, pngle->lz_buf, (mz_uint8 *)pngle->next_out, &out_bytes, TINFL_FLAG_HAS_MORE_INPUT | TINFL_FLAG_PARSE_ZLIB_HEADER);
+			// XXX: tinfl_decompress always requires (next_out - lz_buf + avail_out) == lz_buf_size
+			mz_uint32 flags = TINFL_FLAG_HAS_MORE_INPUT | TINFL_FLAG_PARSE_ZLIB_HEADER;
+			if (pngle->lz_linear) flags |= TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF;
+			tinfl_status status = tinfl_decompress(&pngle->inflator, (const mz_uint8 *)buf, &in_bytes, pngle->lz_buf, (mz_uint8 *)pngle->next_out, &out_bytes, flags);
 
 			//debug_printf("[pngle]       tinfl_decompress\n");
 			//debug_printf("[pngle]       => in_bytes %zd, out_bytes %zd, next_out %p, status %d\n", in_bytes, out_bytes, pngle->next_out, status);
@@ -610,24 +1314,17 @@ static int pngle_handle_chunk(pngle_t *pngle, const uint8_t *buf, size_t len)
 				return PNGLE_ERROR("Failed to decompress the IDAT stream");
 			}
 
-			pngle->next_out   += out_bytes;
-			pngle->avail_out  -= out_bytes;
-
 			// debug_printf("[pngle]         => avail_out %zd, next_out %p\n", pngle->avail_out, pngle->next_out);
 
-			if (status == TINFL_STATUS_DONE || pngle->avail_out == 0) {
-				// Output buffer is full, or decompression is done, so write buffer to output file.
-				// XXX: This is the only chance to process the buffer.
-				uint8_t *read_ptr = pngle->lz_buf;
-				size_t n = TINFL_LZ_DICT_SIZE - (size_t)pngle->avail_out;
+			// Hand the new bytes over right away, so rows (and interlace passes) come out as soon as their data
+			// arrives; they stay in the window for back references until it wraps.
+			pngle->lz_pending = pngle->next_out;
+			pngle->lz_pending_len = out_bytes;
 
-				// pngle_on_data() usually returns n, otherwise -1 on error
-				if (pngle_on_data(pngle, read_ptr, n) < 0) return -1;
+			pngle->next_out   += out_bytes;
+			pngle->avail_out  -= out_bytes;
 
-				// XXX: tinfl_decompress always requires (next_out - lz_buf + avail_out) == TINFL_LZ_DICT_SIZE
-				pngle->next_out = pngle->lz_buf;
-				pngle->avail_out = TINFL_LZ_DICT_SIZE;
-			}
+			if (pngle_flush_lz(pngle) < 0) return -1;
 
 			consume = in_bytes;
 		}
@@ -687,21 +1384,25 @@ static int pngle_handle_chunk(pngle_t *pngle, const uint8_t *buf, size_t len)
 			case 2: consume = 2 * 3; break;
 			case 6: consume = 2 * 3; break;
 			default:
-				return PNGLE_ERROR("tRNS chunk is prohibited on the color type");
+				return PNGLE_ERROR("bKGD chunk is prohibited on the color type");
 			}
 			if (len < consume) return 0;
 
-			uint16_t v[4];
-			size_t ridx = 0;
-			int bitcount = 0;
-			for (size_t c = 0; c < consume; c++) {
-				v[c] = read_pixel_value(buf, &ridx, &bitcount, pngle->hdr.depth, len);
+			// a palette index, or 16-bit samples in the range of the image's bit depth
+			uint16_t v[4] = { 0 };
+			if (pngle->hdr.color_type == 3) {
+				v[0] = read_uint8(buf);
+			} else {
+				for (size_t c = 0; c < consume / 2; c++) {
+					v[c] = MIN((uint16_t)(buf[c * 2] << 8 | buf[c * 2 + 1]), MAXVAL(pngle));
+				}
 			}
 
-			const uint8_t *rgba = adjust_color(pngle, v);
-			if (!rgba) return -1;
+			uint8_t rgba[4];
+			if (adjust_color(pngle, v, rgba) < 0) return -1;
 
 			memcpy(pngle->background_color, rgba, 3);
+			pngle->flags |= PNGLE_FLAG_bKGD;
 		}
 		break;
 
@@ -744,6 +1445,9 @@ static int pngle_feed_internal(pngle_t *pngle, const uint8_t *buf, size_t len)
 		pngle->chunk_remain = read_uint32(buf);
 		pngle->chunk_type = read_uint32(buf + 4);
 
+		// the very first IDAT: peek the zlib CMF byte to size the LZ77 window
+		if (pngle->chunk_type == PNGLE_CHUNK_IDAT && pngle->next_out == NULL && pngle->chunk_remain > 0 && len < 9) return 0;
+
 		pngle->crc32 = mz_crc32(MZ_CRC32_INIT, (const mz_uint8 *)(buf + 4), 4);
 
 		debug_printf("[pngle] Chunk '%.4s' len %u\n", buf + 4, pngle->chunk_remain);
@@ -760,22 +1464,39 @@ static int pngle_feed_internal(pngle_t *pngle, const uint8_t *buf, size_t len)
 		case PNGLE_CHUNK_IDAT:
 			if (pngle->chunk_remain <= 0) return PNGLE_ERROR("Invalid IDAT chunk size");
 			if (pngle->channels == 0) return PNGLE_ERROR("No IHDR chunk is found");
-			if (pngle->hdr.color_type == 3 && pngle->palette == NULL) return PNGLE_ERROR("No PLTE chunk is found");
+			if (pngle->hdr.color_type == 3 && !(pngle->flags & PNGLE_FLAG_PLTE)) return PNGLE_ERROR("No PLTE chunk is found");
 
 			if (pngle->next_out == NULL) {
 				// Very first IDAT
+				// CINFO (upper 4 bits of CMF) is log2(window size) - 8; anything invalid gets the full window and is rejected by tinfl
+				uint8_t cinfo = read_uint8(buf + 8) >> 4;
+				size_t window = cinfo <= 7 ? (256UL << cinfo) : TINFL_LZ_DICT_SIZE;
+
+				// When the whole image data fits (in the window, or in the caller's limit), inflate it in one piece:
+				// no back reference can reach further than the image itself, and tinfl never has to wrap around
+				uint64_t image_size = image_data_size(pngle);
+				pngle->lz_linear = image_size <= MAX(window, pngle->linear_limit);
+				pngle->lz_buf_size = pngle->lz_linear ? (size_t)image_size : window;
+				if (!PNGLE_RESERVE(pngle->lz_buf, pngle->lz_buf_size, 1, "lz buf")) return PNGLE_ERROR("Insufficient memory");
+				debug_printf("[pngle] LZ77 %s: %zd bytes\n", pngle->lz_linear ? "image buffer" : "window", pngle->lz_buf_size);
+
 				pngle->next_out = pngle->lz_buf;
-				pngle->avail_out = TINFL_LZ_DICT_SIZE;
+				pngle->avail_out = pngle->lz_buf_size;
 
 				// callback
 				if (pngle->init_callback) pngle->init_callback(pngle, pngle->hdr.width, pngle->hdr.height);
+
+				if (pngle->scale_w && setup_scaling(pngle) < 0) return -1;
+				setup_flatten(pngle);
+				if (pngle->hdr.color_type == 3 && setup_palette_lut(pngle) < 0) return -1;
+				setup_row_converter(pngle);
 			}
 			break;
 
 		case PNGLE_CHUNK_PLTE:
 			if (pngle->chunk_remain <= 0) return PNGLE_ERROR("Invalid PLTE chunk size");
 			if (pngle->channels == 0) return PNGLE_ERROR("No IHDR chunk is found");
-			if (pngle->palette) return PNGLE_ERROR("Too many PLTE chunk");
+			if (pngle->flags & PNGLE_FLAG_PLTE) return PNGLE_ERROR("Too many PLTE chunk");
 
 			switch (pngle->hdr.color_type) {
 			case 3: // indexed color
@@ -790,7 +1511,8 @@ static int pngle_feed_internal(pngle_t *pngle, const uint8_t *buf, size_t len)
 
 			if (pngle->chunk_remain % 3) return PNGLE_ERROR("Invalid PLTE chunk size");
 			if (pngle->chunk_remain / 3 > MIN(256, (1UL << pngle->hdr.depth))) return PNGLE_ERROR("Too many palettes in PLTE");
-			if ((pngle->palette = (uint8_t *)PNGLE_CALLOC(pngle->chunk_remain / 3, 3, "palette")) == NULL) return PNGLE_ERROR("Insufficient memory");
+			if (!PNGLE_RESERVE(pngle->palette, pngle->chunk_remain / 3, 3, "palette")) return PNGLE_ERROR("Insufficient memory");
+			pngle->flags |= PNGLE_FLAG_PLTE;
 			pngle->n_palettes = 0;
 			break;
 
@@ -802,7 +1524,7 @@ static int pngle_feed_internal(pngle_t *pngle, const uint8_t *buf, size_t len)
 		case PNGLE_CHUNK_tRNS:
 			if (pngle->chunk_remain <= 0) return PNGLE_ERROR("Invalid tRNS chunk size");
 			if (pngle->channels == 0) return PNGLE_ERROR("No IHDR chunk is found");
-			if (pngle->trans_palette) return PNGLE_ERROR("Too many tRNS chunk");
+			if (pngle->flags & PNGLE_FLAG_tRNS) return PNGLE_ERROR("Too many tRNS chunk");
 
 			switch (pngle->hdr.color_type) {
 			case 3: // indexed color
@@ -818,10 +1540,34 @@ static int pngle_feed_internal(pngle_t *pngle, const uint8_t *buf, size_t len)
 			default:
 				return PNGLE_ERROR("tRNS chunk is prohibited on the color type");
 			}
-			if ((pngle->trans_palette = (uint8_t *)PNGLE_CALLOC(pngle->chunk_remain, 1, "trans palette")) == NULL) return PNGLE_ERROR("Insufficient memory");
+			if (!PNGLE_RESERVE(pngle->trans_palette, pngle->chunk_remain, 1, "trans palette")) return PNGLE_ERROR("Insufficient memory");
+			pngle->flags |= PNGLE_FLAG_tRNS;
 			pngle->n_trans_palettes = 0;
 			break;
 
+		case PNGLE_CHUNK_bKGD:
+			// the handler converts the color with the header's bit depth and the palette, and needs the whole chunk at once
+			if (pngle->channels == 0) return PNGLE_ERROR("No IHDR chunk is found");
+
+			switch (pngle->hdr.color_type) {
+			case 3: // indexed color
+				if (!(pngle->flags & PNGLE_FLAG_PLTE)) return PNGLE_ERROR("No PLTE chunk is found");
+				if (pngle->chunk_remain != 1) return PNGLE_ERROR("Invalid bKGD chunk size");
+				break;
+			case 0: // grayscale
+			case 4: // grayscale + alpha
+				if (pngle->chunk_remain != 2) return PNGLE_ERROR("Invalid bKGD chunk size");
+				break;
+			case 2: // truecolor
+			case 6: // truecolor + alpha
+				if (pngle->chunk_remain != 6) return PNGLE_ERROR("Invalid bKGD chunk size");
+				break;
+
+			default:
+				return PNGLE_ERROR("bKGD chunk is prohibited on the color type");
+			}
+			break;
+
 		default:
 			break;
 		}
@@ -838,7 +1584,9 @@ static int pngle_feed_internal(pngle_t *pngle, const uint8_t *buf, size_t len)
 				if (pngle->chunk_remain < (uint32_t)consumed) return PNGLE_ERROR("Chunk data has been consumed too much");
 
 				pngle->chunk_remain -= consumed;
-				pngle->crc32 = mz_crc32(pngle->crc32, (const mz_uint8 *)buf, consumed);
+				if (!(pngle->skip_idat_crc && pngle->chunk_type == PNGLE_CHUNK_IDAT)) {
+					pngle->crc32 = mz_crc32(pngle->crc32, (const mz_uint8 *)buf, consumed);
+				}
 			}
 			if (pngle->chunk_remain <= 0) pngle->state = PNGLE_STATE_CRC;
 
@@ -851,19 +1599,22 @@ static int pngle_feed_internal(pngle_t *pngle, const uint8_t *buf, size_t len)
 
 			uint32_t crc32 = read_uint32(buf);
 
-			if (crc32 != pngle->crc32) {
+			if (pngle->skip_idat_crc && pngle->chunk_type == PNGLE_CHUNK_IDAT) {
+				debug_printf("[pngle] CRC: %08x => not checked\n", crc32);
+			} else if (crc32 != pngle->crc32) {
 				debug_printf("[pngle] CRC: %08x vs %08x => NG\n", crc32, (uint32_t)pngle->crc32);
 				return PNGLE_ERROR("CRC mismatch");
+			} else {
+				debug_printf("[pngle] CRC: %08x vs %08x => OK\n", crc32, (uint32_t)pngle->crc32);
 			}
 
-			debug_printf("[pngle] CRC: %08x vs %08x => OK\n", crc32, (uint32_t)pngle->crc32);
 			pngle->state = PNGLE_STATE_FIND_CHUNK_HEADER;
 
 			// XXX:
 			if (pngle->chunk_type == PNGLE_CHUNK_IEND) {
 				pngle->state = PNGLE_STATE_EOF;
 				if (pngle->done_callback) pngle->done_callback(pngle);
-				debug_printf("[pngle] DONE\n");
+				debug_printf("[pngle] DONE (peak memory %zd bytes)\n", pngle_get_peak_memory(pngle));
 			}
 		}
 		return 4;
@@ -880,7 +1631,11 @@ int pngle_feed(pngle_t *pngle, const void *buf, size_t len)
 	size_t pos = 0;
 	pngle_state_t last_state = pngle->state;
 
-	while (pos < len) {
+	// resume: rows left over from a suspended call come before any new input
+	pngle->suspended = 0;
+	if (pngle->state != PNGLE_STATE_ERROR && pngle_flush_lz(pngle) < 0) return -1;
+
+	while (pos < len && !pngle->suspended) {
 		int r = pngle_feed_internal(pngle, (const uint8_t *)buf + pos, len - pos);
 		if (r < 0) return r; // error
 
@@ -893,6 +1648,12 @@ int pngle_feed(pngle_t *pngle, const void *buf, size_t len)
 	return pos;
 }
 
+void pngle_suspend(pngle_t *pngle)
+{
+	if (!pngle) return ;
+	pngle->suspended = 1;
+}
+
 void pngle_set_display_gamma(pngle_t *pngle, double display_gamma)
 {
 	if (!pngle) return ;
@@ -903,6 +1664,35 @@ void pngle_set_display_gamma(pngle_t *pngle, double display_gamma)
 #endif
 }
 
+void pngle_set_idat_crc_check(pngle_t *pngle, int enabled)
+{
+	if (!pngle) return ;
+	pngle->skip_idat_crc = !enabled;
+}
+
+void pngle_set_progressive(pngle_t *pngle, int enabled)
+{
+	if (!pngle) return ;
+	pngle->progressive = enabled ? 1 : 0;
+}
+
+void pngle_set_flatten(pngle_t *pngle, pngle_flatten_t mode, const uint8_t rgb[3])
+{
+	if (!pngle) return ;
+	pngle->flatten = mode;
+	if (rgb) {
+		memcpy(pngle->flatten_color, rgb, 3);
+	} else {
+		memset(pngle->flatten_color, 0, 3);
+	}
+}
+
+void pngle_set_linear_inflate_limit(pngle_t *pngle, size_t limit)
+{
+	if (!pngle) return ;
+	pngle->linear_limit = limit;
+}
+
 void pngle_set_init_callback(pngle_t *pngle, pngle_init_callback_t callback)
 {
 	if (!pngle) return ;
@@ -915,12 +1705,46 @@ void pngle_set_draw_callback(pngle_t *pngle, pngle_draw_callback_t callback)
 	pngle->draw_callback = callback;
 }
 
+void pngle_set_row_callback(pngle_t *pngle, pngle_row_callback_t callback)
+{
+	if (!pngle) return ;
+	pngle->row_callback = callback;
+}
+
 void pngle_set_done_callback(pngle_t *pngle, pngle_done_callback_t callback)
 {
 	if (!pngle) return ;
 	pngle->done_callback = callback;
 }
 
+void pngle_set_pass_callback(pngle_t *pngle, pngle_pass_callback_t callback)
+{
+	if (!pngle) return ;
+	pngle->pass_callback = callback;
+}
+
+void pngle_set_output_buffer(pngle_t *pngle, pngle_pixel_format_t format, void *buf, uint32_t stride, uint32_t width, uint32_t height)
+{
+	if (!pngle) return ;
+	pngle->out_format = format;
+	pngle->out_buf = (uint8_t *)buf;
+	pngle->out_stride = stride;
+	pngle->out_width = width;
+	pngle->out_height = height;
+}
+
+void pngle_set_scaling(pngle_t *pngle, uint32_t width, uint32_t height, uint32_t crop_x, uint32_t crop_y, uint32_t crop_w, uint32_t crop_h, pngle_scale_filter_t filter)
+{
+	if (!pngle) return ;
+	pngle->scale_w = (width && height) ? width : 0;
+	pngle->scale_h = (width && height) ? height : 0;
+	pngle->crop_x = crop_x;
+	pngle->crop_y = crop_y;
+	pngle->crop_w = crop_w;
+	pngle->crop_h = crop_h;
+	pngle->scale_filter = filter;
+}
+
 void pngle_set_user_data(pngle_t *pngle, void *user_data)
 {
 	if (!pngle) return ;
@@ -933,6 +1757,12 @@ void *pngle_get_user_data(pngle_t *pngle)
 	return pngle->user_data;
 }
 
+size_t pngle_get_peak_memory(pngle_t *pngle)
+{
+	if (!pngle) return 0;
+	return sizeof(pngle_t) + pngle->mem_peak;
+}
+
 const uint8_t *pngle_get_background_color(pngle_t *pngle)
 {
 	if (!pngle) return NULL;
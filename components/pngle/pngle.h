@@ -25,6 +25,7 @@
 #ifndef __PNGLE_H__
 #define __PNGLE_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -39,24 +40,100 @@ extern const size_t PNGLE_T_SIZE;  // size of pngle_t structure
 // Callback signatures
 typedef void (*pngle_init_callback_t)(pngle_t *pngle, uint32_t w, uint32_t h);
 typedef void (*pngle_draw_callback_t)(pngle_t *pngle, uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint8_t rgba[4]);
+typedef void (*pngle_row_callback_t)(pngle_t *pngle, uint32_t x, uint32_t y, uint32_t dx, uint32_t n, const uint8_t *rgba); // n RGBA pixels at (x + i * dx, y)
 typedef void (*pngle_done_callback_t)(pngle_t *pngle);
+typedef void (*pngle_pass_callback_t)(pngle_t *pngle, int pass); // Adam7 pass 1-7
+
+// Output pixel formats for pngle_set_output_buffer()
+typedef enum {
+	PNGLE_PIXEL_FORMAT_RGBA8888 = 0, // 4 bytes per pixel, R, G, B, A
+	PNGLE_PIXEL_FORMAT_RGB565,       // 2 bytes per pixel, native byte order (LV_COLOR_16_SWAP=0)
+	PNGLE_PIXEL_FORMAT_RGB565_SWAP,  // 2 bytes per pixel, high byte first (LV_COLOR_16_SWAP=1)
+} pngle_pixel_format_t;
+
+// Filters for pngle_set_scaling()
+typedef enum {
+	PNGLE_SCALE_NEAREST = 0,
+	PNGLE_SCALE_BOX, // averages source pixels; used for downscaling of non-interlaced images, nearest otherwise
+} pngle_scale_filter_t;
+
+// Backgrounds for pngle_set_flatten()
+typedef enum {
+	PNGLE_FLATTEN_NONE = 0, // keep alpha
+	PNGLE_FLATTEN_COLOR,    // the caller's color
+	PNGLE_FLATTEN_BKGD,     // the image's bKGD color, or the caller's color if it has none
+} pngle_flatten_t;
+
+// Heap interface; free() is only called from pngle_destroy() or when a kept buffer is too small for the next image
+typedef struct _pngle_allocator_t {
+	void *(*alloc)(void *ctx, size_t size);
+	void (*free)(void *ctx, void *ptr);
+	void *ctx;
+} pngle_allocator_t;
 
 // ----------------
 // Basic interfaces
 // ----------------
+
+// Thread safety: all decoder state lives in pngle_t (library tables are read-only), so separate instances can decode
+// concurrently from different tasks without locking. One instance must not be used from two tasks at once; callbacks
+// run on the task calling pngle_feed(). A shared custom allocator must be thread-safe itself.
 pngle_t *pngle_new();
+pngle_t *pngle_new_with_allocator(const pngle_allocator_t *allocator); // NULL selects malloc/free
 void pngle_destroy(pngle_t *pngle);
-void pngle_reset(pngle_t *pngle); // clear its internal state (not applied to pngle_set_* functions)
+void pngle_reset(pngle_t *pngle); // clear its internal state (not applied to pngle_set_* functions); keeps buffers for the next image
 const char *pngle_error(pngle_t *pngle);
 int pngle_feed(pngle_t *pngle, const void *buf, size_t len); // returns -1: On error, 0: Need more data, n: n bytes eaten
 
+// Call from a draw/row callback to make pngle_feed() return right after the current scanline, so rows can be pulled
+// one at a time (a scanline may complete more than one output row when scaling). Inflated data that is already
+// buffered is kept; the next pngle_feed() (len may be 0) resumes from it.
+void pngle_suspend(pngle_t *pngle);
+
 uint32_t pngle_get_width(pngle_t *pngle);
 uint32_t pngle_get_height(pngle_t *pngle);
 const uint8_t *pngle_get_background_color(pngle_t *pngle);
+// Peak bytes held by pngle since pngle_new() or the last pngle_reset(), including pngle_t itself and the buffers a
+// reset keeps for reuse (so after a reset it starts at what the previous images left allocated, not at zero)
+size_t pngle_get_peak_memory(pngle_t *pngle);
 
 void pngle_set_init_callback(pngle_t *png, pngle_init_callback_t callback);
-void pngle_set_draw_callback(pngle_t *png, pngle_draw_callback_t callback);
+void pngle_set_draw_callback(pngle_t *png, pngle_draw_callback_t callback); // called per pixel; built on top of the row callback
+void pngle_set_row_callback(pngle_t *png, pngle_row_callback_t callback); // called once per decoded scanline (or interlace pass row); dx > 1 on interlace passes
 void pngle_set_done_callback(pngle_t *png, pngle_done_callback_t callback);
+void pngle_set_pass_callback(pngle_t *png, pngle_pass_callback_t callback); // called after the last row of each interlace pass; passes without pixels are skipped
+
+// Decode straight into a caller-provided buffer (e.g. the data of an lv_img_dsc_t with LV_IMG_CF_TRUE_COLOR).
+// stride is in bytes; pixels outside width x height are clipped. RGB565 formats drop alpha (see pngle_set_flatten()).
+// While a buffer is set, draw and row callbacks are not called. Pass buf = NULL to go back to callbacks.
+void pngle_set_output_buffer(pngle_t *pngle, pngle_pixel_format_t format, void *buf, uint32_t stride, uint32_t width, uint32_t height);
+
+// Scale the crop rectangle of the source to width x height while decoding; draw/row callbacks and the output buffer
+// then see output coordinates. crop_w or crop_h = 0 selects a center crop with the aspect ratio of width x height.
+// Takes effect on the first IDAT, so it may be called from the init callback. Pass width = 0 to disable.
+// Interlaced images can only be scaled into an output buffer.
+void pngle_set_scaling(pngle_t *pngle, uint32_t width, uint32_t height, uint32_t crop_x, uint32_t crop_y, uint32_t crop_w, uint32_t crop_h, pngle_scale_filter_t filter);
+
+// Progressive display of interlaced images: each pixel of passes 1-6 fills the block it stands for in the output buffer
+// (as the draw callback's w x h), so the buffer holds a coarse preview of the whole image after pass 1 that later passes
+// refine in place. Flush it to the screen from the pass callback, e.g. after pass 1-3; pngle_suspend() works there too.
+// No effect on callbacks or non-interlaced images.
+void pngle_set_progressive(pngle_t *pngle, int enabled);
+
+// Blend transparent pixels over a background while decoding, so every pixel comes out opaque (alpha 255) and e.g. LVGL
+// can draw the result without blending it again on every refresh. Applies to callbacks and the output buffer alike.
+// rgb = NULL selects black. Takes effect on the first IDAT, so it may be called from the init callback.
+void pngle_set_flatten(pngle_t *pngle, pngle_flatten_t mode, const uint8_t rgb[3]);
+
+// Inflated data goes through an LZ77 window of the size the zlib header declares (up to 32 KB), except for images whose
+// filtered rows fit in it: those are inflated in one piece into a buffer of exactly their size, which is smaller and
+// needs no wrap-around. A limit extends that to images of up to limit bytes of filtered rows (about height * (1 + width
+// * bytes per pixel)), e.g. when there is memory to spare. Takes effect on the first IDAT. 0 (default) disables it.
+void pngle_set_linear_inflate_limit(pngle_t *pngle, size_t limit);
+
+// IDAT CRCs are verified by default. Disable it when the transport already guarantees integrity (e.g. TLS/TCP);
+// the zlib Adler-32 still catches corrupted image data. Other chunks are always checked.
+void pngle_set_idat_crc_check(pngle_t *pngle, int enabled);
 
 void pngle_set_display_gamma(pngle_t *pngle, double display_gamma); // enables gamma correction by specifying display gamma, typically 2.2. No effect when gAMA chunk is missing
 
@@ -40,6 +40,10 @@
 #define LVGL_TASK_STACK_SIZE    (4 * 1024)
 #define LVGL_TASK_PRIORITY      2
 
+// Thumbnail decode task (JPEG album art); below LVGL so decoding never holds up rendering
+#define THUMB_TASK_STACK_SIZE   (4 * 1024)
+#define THUMB_TASK_PRIORITY     1
+
 // Feature Flags
 #define ENABLE_DISPLAY  1
 #define ENABLE_TOUCH    1
@@ -52,10 +56,14 @@
 
 // MQTT Configuration
 #define MQTT_BROKER_URI  "mqtt://192.168.16.100:1883"
-#define MQTT_TOPIC_STATE "hass.agent/media_player/DESTEPTUL/state"
+// Media player topics: MQTT_PLAYER_PREFIX "<id>" MQTT_PLAYER_STATE etc.
+#define MQTT_PLAYER_PREFIX  "hass.agent/media_player/"
+#define MQTT_PLAYER_DEFAULT "DESTEPTUL"         // Displayed at startup
+#define MQTT_PLAYER_MAX     4                   // Players kept in memory (state and thumbnail each)
+#define MQTT_PLAYER_STATE   "/state"
 // Use the optimized thumbnail topic from the Rust converter service (64x64 JPEG)
-#define MQTT_TOPIC_THUMB "hass.agent/media_player/DESTEPTUL/thumbnail_small"
-#define MQTT_TOPIC_CMD   "hass.agent/media_player/DESTEPTUL/cmd"
+#define MQTT_PLAYER_THUMB   "/thumbnail_small"
+#define MQTT_PLAYER_CMD     "/cmd"
 
 // Application Configuration
 #define APP_TAG         "MediaController"
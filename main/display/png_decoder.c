@@ -0,0 +1,300 @@
+#include "png_decoder.h"
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "pngle.h"
+
+#if LV_COLOR_DEPTH != 16
+#error "png_decoder writes RGB565 pixels; LV_COLOR_DEPTH must be 16"
+#endif
+
+static const char *TAG = "png_decoder";
+
+#define PNG_HEADER_SIZE 33      // signature + IHDR chunk
+#define PNG_MAX_DIMENSION 2047  // lv_img_header_t stores w/h in 11 bits
+
+static const uint8_t png_signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+typedef struct {
+    uint32_t src_w;
+    uint32_t src_h;
+    uint32_t w;          // Decoded size (after downscaling to s_max_height)
+    uint32_t h;
+    bool interlaced;
+    bool alpha;
+} png_info_t;
+
+// Per-open decoder state, stored in lv_img_decoder_dsc_t.user_data
+typedef struct {
+    pngle_t *pngle;
+    const uint8_t *data;
+    size_t data_len;
+    size_t pos;          // Bytes of data already fed to pngle
+    uint8_t *lines;      // Two decoded rows in LVGL pixel format, row y in slot y & 1
+    int32_t line_y[2];   // Row held in each slot, -1 if none
+    uint8_t px_size;
+    uint32_t width;
+    int32_t next_y;      // Next row pngle will produce
+    int32_t want_y;      // Row read_line_cb is waiting for
+} png_ctx_t;
+
+static lv_coord_t s_max_height = 0;
+
+// One idle decoder is kept so its buffers are reused by the next open
+static pngle_t *s_idle_pngle = NULL;
+
+static inline uint32_t read_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static bool png_get_info(const void *src, png_info_t *info)
+{
+    if (lv_img_src_get_type(src) != LV_IMG_SRC_VARIABLE) {
+        return false;
+    }
+
+    const lv_img_dsc_t *img = (const lv_img_dsc_t *)src;
+    if (img->header.cf != LV_IMG_CF_RAW && img->header.cf != LV_IMG_CF_RAW_ALPHA) {
+        return false;
+    }
+    if (img->data == NULL || img->data_size < PNG_HEADER_SIZE) {
+        return false;
+    }
+
+    const uint8_t *p = img->data;
+    if (memcmp(p, png_signature, sizeof(png_signature)) != 0 || memcmp(p + 12, "IHDR", 4) != 0) {
+        return false;
+    }
+
+    info->src_w = read_be32(p + 16);
+    info->src_h = read_be32(p + 20);
+    info->alpha = (p[25] == 4 || p[25] == 6);  // Grayscale + alpha, truecolor + alpha
+    info->interlaced = (p[28] != 0);
+    if (info->src_w == 0 || info->src_h == 0) {
+        return false;
+    }
+
+    info->w = info->src_w;
+    info->h = info->src_h;
+    if (s_max_height > 0 && info->h > (uint32_t)s_max_height) {
+        info->w = (uint32_t)(((uint64_t)info->src_w * s_max_height + info->src_h / 2) / info->src_h);
+        if (info->w == 0) {
+            info->w = 1;
+        }
+        info->h = s_max_height;
+    }
+
+    return info->w <= PNG_MAX_DIMENSION && info->h <= PNG_MAX_DIMENSION;
+}
+
+static pngle_t *png_acquire(void)
+{
+    pngle_t *pngle = s_idle_pngle;
+    s_idle_pngle = NULL;
+    return pngle ? pngle : pngle_new();
+}
+
+static void png_release(pngle_t *pngle)
+{
+    if (pngle == NULL) {
+        return;
+    }
+    if (s_idle_pngle == NULL) {
+        pngle_reset(pngle);
+        s_idle_pngle = pngle;
+    } else {
+        pngle_destroy(pngle);
+    }
+}
+
+// Converts the wanted row into its slot and pauses pngle right after it. Downscaling may finish two output
+// rows on one source row, so the row after the wanted one is kept as well.
+static void png_row_cb(pngle_t *pngle, uint32_t x, uint32_t y, uint32_t dx, uint32_t n, const uint8_t *rgba)
+{
+    png_ctx_t *ctx = (png_ctx_t *)pngle_get_user_data(pngle);
+    ctx->next_y = y + 1;
+    if ((int32_t)y < ctx->want_y || (int32_t)y > ctx->want_y + 1) {
+        return;
+    }
+
+    uint8_t *dst = ctx->lines + ((y & 1) * ctx->width + x) * ctx->px_size;
+    for (uint32_t i = 0; i < n; i++, rgba += 4, dst += ctx->px_size) {
+        lv_color_t c = lv_color_make(rgba[0], rgba[1], rgba[2]);
+        memcpy(dst, &c, sizeof(c));
+        if (ctx->px_size == LV_IMG_PX_SIZE_ALPHA_BYTE) {
+            dst[sizeof(c)] = rgba[3];
+        }
+    }
+
+    ctx->line_y[y & 1] = y;
+    if ((int32_t)y == ctx->want_y) {
+        pngle_suspend(pngle);
+    }
+}
+
+static lv_res_t png_info_cb(lv_img_decoder_t *decoder, const void *src, lv_img_header_t *header)
+{
+    png_info_t info;
+    if (!png_get_info(src, &info)) {
+        return LV_RES_INV;
+    }
+
+    header->always_zero = 0;
+    header->cf = (info.alpha && !info.interlaced) ? LV_IMG_CF_TRUE_COLOR_ALPHA : LV_IMG_CF_TRUE_COLOR;
+    header->w = info.w;
+    header->h = info.h;
+
+    return LV_RES_OK;
+}
+
+static lv_res_t png_open_cb(lv_img_decoder_t *decoder, lv_img_decoder_dsc_t *dsc)
+{
+    png_info_t info;
+    if (!png_get_info(dsc->src, &info)) {
+        return LV_RES_INV;
+    }
+
+    const lv_img_dsc_t *img = (const lv_img_dsc_t *)dsc->src;
+
+    pngle_t *pngle = png_acquire();
+    if (pngle == NULL) {
+        ESP_LOGE(TAG, "Failed to create PNG decoder");
+        return LV_RES_INV;
+    }
+
+    // Settings survive pngle_reset(), so set every one of them for this image
+    pngle_set_init_callback(pngle, NULL);
+    pngle_set_draw_callback(pngle, NULL);
+    pngle_set_done_callback(pngle, NULL);
+    pngle_set_row_callback(pngle, png_row_cb);
+    pngle_set_output_buffer(pngle, PNGLE_PIXEL_FORMAT_RGB565, NULL, 0, 0, 0);
+    if (info.w != info.src_w || info.h != info.src_h) {
+        pngle_set_scaling(pngle, info.w, info.h, 0, 0, 0, 0, PNGLE_SCALE_BOX);
+    } else {
+        pngle_set_scaling(pngle, 0, 0, 0, 0, 0, 0, PNGLE_SCALE_NEAREST);
+    }
+
+    if (info.interlaced) {
+        // Adam7 rows arrive out of order: decode the whole frame up front
+        uint8_t *frame = malloc(info.w * info.h * sizeof(lv_color_t));
+        if (frame == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate %lux%lu frame", (unsigned long)info.w, (unsigned long)info.h);
+            png_release(pngle);
+            return LV_RES_INV;
+        }
+
+#if LV_COLOR_16_SWAP
+        pngle_set_output_buffer(pngle, PNGLE_PIXEL_FORMAT_RGB565_SWAP, frame, info.w * sizeof(lv_color_t), info.w, info.h);
+#else
+        pngle_set_output_buffer(pngle, PNGLE_PIXEL_FORMAT_RGB565, frame, info.w * sizeof(lv_color_t), info.w, info.h);
+#endif
+        int fed = pngle_feed(pngle, img->data, img->data_size);
+        if (fed < 0) {
+            ESP_LOGE(TAG, "PNG decode failed: %s", pngle_error(pngle));
+            free(frame);
+            png_release(pngle);
+            return LV_RES_INV;
+        }
+
+        png_release(pngle);
+        dsc->img_data = frame;
+        dsc->user_data = NULL;
+        return LV_RES_OK;
+    }
+
+    png_ctx_t *ctx = calloc(1, sizeof(png_ctx_t));
+    uint8_t px_size = info.alpha ? LV_IMG_PX_SIZE_ALPHA_BYTE : sizeof(lv_color_t);
+    uint8_t *lines = malloc(2 * info.w * px_size);
+    if (ctx == NULL || lines == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate line buffer");
+        free(ctx);
+        free(lines);
+        png_release(pngle);
+        return LV_RES_INV;
+    }
+
+    ctx->pngle = pngle;
+    ctx->data = img->data;
+    ctx->data_len = img->data_size;
+    ctx->lines = lines;
+    ctx->line_y[0] = ctx->line_y[1] = -1;
+    ctx->px_size = px_size;
+    ctx->width = info.w;
+    pngle_set_user_data(pngle, ctx);
+
+    dsc->img_data = NULL;  // Pixels are pulled through read_line_cb
+    dsc->user_data = ctx;
+    return LV_RES_OK;
+}
+
+static lv_res_t png_read_line_cb(lv_img_decoder_t *decoder, lv_img_decoder_dsc_t *dsc,
+                                 lv_coord_t x, lv_coord_t y, lv_coord_t len, uint8_t *buf)
+{
+    png_ctx_t *ctx = (png_ctx_t *)dsc->user_data;
+    if (ctx == NULL || x < 0 || len < 0 || (uint32_t)(x + len) > ctx->width) {
+        return LV_RES_INV;
+    }
+
+    int32_t *slot_y = &ctx->line_y[y & 1];
+    if (*slot_y != y && y < ctx->next_y) {
+        // pngle only moves forward: start over for rows above the current one
+        pngle_reset(ctx->pngle);
+        ctx->pos = 0;
+        ctx->next_y = 0;
+        ctx->line_y[0] = ctx->line_y[1] = -1;
+    }
+
+    ctx->want_y = y;
+    while (*slot_y != y) {
+        int fed = pngle_feed(ctx->pngle, ctx->data + ctx->pos, ctx->data_len - ctx->pos);
+        if (fed < 0) {
+            ESP_LOGE(TAG, "PNG decode failed: %s", pngle_error(ctx->pngle));
+            return LV_RES_INV;
+        }
+        ctx->pos += fed;
+
+        if (fed == 0 && *slot_y != y) {
+            ESP_LOGE(TAG, "PNG data ended before row %d", y);
+            return LV_RES_INV;
+        }
+    }
+
+    memcpy(buf, ctx->lines + ((y & 1) * ctx->width + x) * ctx->px_size, len * ctx->px_size);
+    return LV_RES_OK;
+}
+
+static void png_close_cb(lv_img_decoder_t *decoder, lv_img_decoder_dsc_t *dsc)
+{
+    png_ctx_t *ctx = (png_ctx_t *)dsc->user_data;
+    if (ctx != NULL) {
+        png_release(ctx->pngle);
+        free(ctx->lines);
+        free(ctx);
+        dsc->user_data = NULL;
+    }
+
+    if (dsc->img_data != NULL) {
+        free((void *)dsc->img_data);
+        dsc->img_data = NULL;
+    }
+}
+
+esp_err_t png_decoder_init(lv_coord_t max_height)
+{
+    lv_img_decoder_t *decoder = lv_img_decoder_create();
+    if (decoder == NULL) {
+        ESP_LOGE(TAG, "Failed to create LVGL image decoder");
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_max_height = max_height;
+
+    lv_img_decoder_set_info_cb(decoder, png_info_cb);
+    lv_img_decoder_set_open_cb(decoder, png_open_cb);
+    lv_img_decoder_set_read_line_cb(decoder, png_read_line_cb);
+    lv_img_decoder_set_close_cb(decoder, png_close_cb);
+
+    ESP_LOGI(TAG, "PNG decoder registered (max height %d)", max_height);
+    return ESP_OK;
+}
@@ -0,0 +1,26 @@
+#ifndef PNG_DECODER_H
+#define PNG_DECODER_H
+
+#include "esp_err.h"
+#include "lvgl.h"
+
+/**
+ * @brief Register pngle as a streaming LVGL image decoder
+ *
+ * Handles LV_IMG_CF_RAW / LV_IMG_CF_RAW_ALPHA image descriptors holding PNG data.
+ * Non-interlaced images are decoded line by line through read_line_cb, so no
+ * full-frame buffer is allocated. Interlaced images are decoded into a frame buffer
+ * (RGB565, alpha dropped) because their rows arrive out of order.
+ *
+ * LVGL 8 can't zoom or rotate images it reads line by line, so images taller than
+ * max_height are downscaled while decoding and report the scaled size from info_cb.
+ *
+ * Must be called after lv_init() and after any other decoder that also claims PNG,
+ * since the most recently created decoder is tried first.
+ *
+ * @param max_height Maximum decoded height in pixels, 0 for no limit
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t png_decoder_init(lv_coord_t max_height);
+
+#endif // PNG_DECODER_H
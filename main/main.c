@@ -10,10 +10,12 @@
 #include "app_config.h"
 #include "network/wifi_manager.h"
 #include "network/mqtt_handler.h"
+#include "network/media_players.h"
 #include "display/display_driver.h"
 #include "display/lvgl_setup.h"
 #include "ui/ui_manager.h"
 #include "ui/ui_media.h"
+#include "ui/thumbnail.h"
 
 static const char *TAG = APP_TAG;
 
@@ -72,11 +74,19 @@ void app_main(void)
         return;
     }
     
-    // Share the thumbnail buffer with MQTT handler to avoid duplicate allocation
-    size_t thumb_buf_size = 0;
-    uint8_t *thumb_buf = ui_media_get_thumbnail_buffer(&thumb_buf_size);
-    mqtt_handler_set_thumbnail_buffer(thumb_buf, thumb_buf_size);
-    ESP_LOGI(TAG, "Shared thumbnail buffer: %p (%zu bytes)", thumb_buf, thumb_buf_size);
+    // PNG thumbnails decode straight from MQTT fragments; JPEG ones go to the thumbnail decode task
+    ret = thumbnail_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize thumbnail decoder");
+        return;
+    }
+    
+    // Per-player state and art, filled in as each player's topics arrive
+    ret = media_players_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize media players");
+        return;
+    }
     
     // Start MQTT client
     ret = mqtt_handler_start();
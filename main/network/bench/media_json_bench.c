@@ -0,0 +1,443 @@
+/*
+ * Host-side benchmark of the media state parser (media_json.c) against the cJSON path it replaced.
+ *
+ * Parses a synthesized corpus of Home Assistant state messages (plus any JSON files given on the
+ * command line) and reports per message size class:
+ *   ns/msg  parse time per message
+ *   MB/s    payload bytes per second
+ *   allocs  heap allocations per message and the bytes they request (media_json makes none)
+ * Every message is also parsed both ways and the resulting media_state_t compared; malformed messages
+ * must be rejected by both. The exit status is non-zero on any mismatch.
+ *
+ * Without cJSON (see CMakeLists.txt) only media_json is timed and checked against the expected fields.
+ *
+ * usage: media_json_bench [-t seconds] [-n messages] [file.json ...]
+ *   -t  minimum timed duration per parser and size class (default 0.2)
+ *   -n  synthesized messages (default 200)
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "media_json.h"
+
+#if HAVE_CJSON
+#include "cJSON.h"
+#endif
+
+#define MAX_MESSAGE 4096        // MQTT buffer size of the firmware
+
+typedef struct {
+    char *json;
+    size_t len;
+    bool valid;                 // Expected result of parsing
+    bool known;                 // expect holds the fields (synthesized messages)
+    media_state_t expect;
+} message_t;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint32_t rng_next(uint32_t *state)
+{
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// ----------------
+// Corpus
+// ----------------
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t size;
+} out_t;
+
+static void emit(out_t *o, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void emit(out_t *o, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(o->buf + o->len, o->size - o->len, fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        o->len += (size_t)n < o->size - o->len ? (size_t)n : o->size - o->len - 1;
+    }
+}
+
+// Appends a JSON string for text, escaping some characters with \u so both parsers have to decode them
+static void emit_string(out_t *o, const char *text, uint32_t *rng)
+{
+    emit(o, "\"");
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            emit(o, "\\%c", *p);
+        } else if (*p == '\n') {
+            emit(o, "\\n");
+        } else if (*p < 0x80 && *p >= 0x20 && (rng_next(rng) & 15) == 0) {
+            emit(o, "\\u%04x", *p);
+        } else {
+            emit(o, "%c", *p);
+        }
+    }
+    emit(o, "\"");
+}
+
+static const char *s_words[] = {
+    "Night", "Drive", "Blue", "Monday", "Caf\xc3\xa9", "Ni\xc3\xb1o", "\xe6\x9d\xb1\xe4\xba\xac", "Live",
+    "Remastered", "\"Edit\"", "Back\\Slash", "Fire", "\xf0\x9f\x94\xa5", "Orchestra", "Theme", "Part",
+};
+
+static void make_text(char *out, size_t size, uint32_t *rng, int words)
+{
+    size_t len = 0;
+    out[0] = '\0';
+    for (int i = 0; i < words; i++) {
+        const char *w = s_words[rng_next(rng) % (sizeof(s_words) / sizeof(s_words[0]))];
+        int n = snprintf(out + len, size - len, "%s%s", i ? " " : "", w);
+        if (n < 0 || (size_t)n >= size - len) {
+            break;
+        }
+        len += n;
+    }
+}
+
+// One Home Assistant media_player state message with the attributes a typical player sends
+static void synth_message(message_t *m, uint32_t seed)
+{
+    uint32_t rng = seed * 2654435761u + 1;
+    out_t o = { .buf = malloc(MAX_MESSAGE), .size = MAX_MESSAGE };
+    char title[512];
+    char artist[256];
+    static const char *states[] = { "playing", "paused", "idle", "playing" };
+
+    // Mostly short titles, some past the 127 bytes media_state_t keeps
+    make_text(title, sizeof(title), &rng, 1 + rng_next(&rng) % ((seed % 10) == 0 ? 40 : 6));
+    make_text(artist, sizeof(artist), &rng, 1 + rng_next(&rng) % 4);
+    const char *state = states[rng_next(&rng) % 4];
+    uint32_t duration = 60 + rng_next(&rng) % 600;
+    uint32_t position = rng_next(&rng) % duration;
+    bool fraction = rng_next(&rng) & 1;
+    bool pretty = (rng_next(&rng) & 3) == 0;
+    int extra = rng_next(&rng) % 4;  // How much else the message carries
+    const char *sep = pretty ? ",\n  " : ",";
+
+    memset(&m->expect, 0, sizeof(m->expect));
+    snprintf(m->expect.title, sizeof(m->expect.title), "%s", title);
+    snprintf(m->expect.artist, sizeof(m->expect.artist), "%s", artist);
+    m->expect.duration_sec = duration;
+    m->expect.position_sec = position;
+    m->expect.is_playing = strcmp(state, "playing") == 0;
+
+    emit(&o, pretty ? "{\n  " : "{");
+    emit(&o, "\"state\": \"%s\"%s", state, sep);
+    if (extra >= 1) {
+        emit(&o, "\"volume\": 0.%02u%s\"muted\": %s%s", (unsigned)(rng_next(&rng) % 100), sep,
+             (rng_next(&rng) & 1) ? "true" : "false", sep);
+    }
+    emit(&o, "\"title\": ");
+    emit_string(&o, title, &rng);
+    emit(&o, "%s\"artist\": ", sep);
+    emit_string(&o, artist, &rng);
+    emit(&o, "%s\"album\": ", sep);
+    emit_string(&o, artist, &rng);
+    if (fraction) {
+        emit(&o, "%s\"duration\": %u.%03u%s\"currentposition\": %u.%03u", sep, (unsigned)duration,
+             (unsigned)(rng_next(&rng) % 1000), sep, (unsigned)position, (unsigned)(rng_next(&rng) % 1000));
+    } else {
+        emit(&o, "%s\"duration\": %u%s\"currentposition\": %u", sep, (unsigned)duration, sep, (unsigned)position);
+    }
+    if (extra >= 2) {
+        emit(&o, "%s\"thumbnail\": \"http://homeassistant.local:8123/api/media_player_proxy/media_player.desktop"
+             "?token=%08x%08x%08x%08x&cache=%08x\"", sep, (unsigned)rng_next(&rng), (unsigned)rng_next(&rng),
+             (unsigned)rng_next(&rng), (unsigned)rng_next(&rng), (unsigned)rng_next(&rng));
+        emit(&o, "%s\"source_list\": [\"Spotify\", \"Chrome\", \"VLC media player\", \"Windows Media Player\"]", sep);
+    }
+    if (extra >= 3) {
+        // Nested attributes that repeat our keys, which must not override the top-level ones
+        emit(&o, "%s\"attributes\": {\"title\": \"nested\", \"duration\": 1, \"queue\": [", sep);
+        int n = 4 + rng_next(&rng) % 12;
+        for (int i = 0; i < n; i++) {
+            char item[128];
+            make_text(item, sizeof(item), &rng, 1 + rng_next(&rng) % 5);
+            emit(&o, "%s{\"title\": ", i ? ", " : "");
+            emit_string(&o, item, &rng);
+            emit(&o, ", \"duration\": %u, \"explicit\": null}", (unsigned)(60 + rng_next(&rng) % 600));
+        }
+        emit(&o, "]}");
+    }
+    emit(&o, pretty ? "\n}\n" : "}");
+
+    m->json = o.buf;
+    m->len = o.len;
+    m->valid = true;
+    m->known = true;
+}
+
+// Messages both parsers must reject
+static const char *s_malformed[] = {
+    "",
+    "{",
+    "{\"title\": \"unterminated}",
+    "{\"title\": \"Song\", }",
+    "{\"title\" \"Song\"}",
+    "{\"title\": \"bad \\q escape\"}",
+    "{\"title\": \"lone \\udc00 surrogate\"}",
+    "{\"title\": \"Song\", \"duration\": }",
+    "{\"title\": \"Song\", \"list\": [1, 2}",
+    "{\"title\": \"Song\", \"flag\": tru}",
+    "[\"title\", \"Song\"]",
+};
+
+// ----------------
+// Parsers
+// ----------------
+
+#if HAVE_CJSON
+static size_t s_allocs;
+static size_t s_alloc_bytes;
+
+static void *counting_malloc(size_t size)
+{
+    s_allocs++;
+    s_alloc_bytes += size;
+    return malloc(size);
+}
+
+// The parser the firmware used before media_json.c
+static bool parse_cjson(const char *data, size_t len, media_state_t *state)
+{
+    cJSON *json = cJSON_ParseWithLength(data, len);
+    if (json == NULL) {
+        return false;
+    }
+
+    cJSON *title = cJSON_GetObjectItem(json, "title");
+    if (title && cJSON_IsString(title)) {
+        strncpy(state->title, title->valuestring, sizeof(state->title) - 1);
+    }
+
+    cJSON *artist = cJSON_GetObjectItem(json, "artist");
+    if (artist && cJSON_IsString(artist)) {
+        strncpy(state->artist, artist->valuestring, sizeof(state->artist) - 1);
+    }
+
+    cJSON *duration = cJSON_GetObjectItem(json, "duration");
+    if (duration && cJSON_IsNumber(duration)) {
+        state->duration_sec = (uint32_t)duration->valuedouble;
+    }
+
+    cJSON *position = cJSON_GetObjectItem(json, "currentposition");
+    if (position && cJSON_IsNumber(position)) {
+        state->position_sec = (uint32_t)position->valuedouble;
+    }
+
+    cJSON *play_state = cJSON_GetObjectItem(json, "state");
+    if (play_state && cJSON_IsString(play_state)) {
+        state->is_playing = (strcmp(play_state->valuestring, "playing") == 0);
+    }
+
+    bool ok = cJSON_IsObject(json);
+    cJSON_Delete(json);
+    return ok;
+}
+#endif
+
+static bool same_state(const media_state_t *a, const media_state_t *b)
+{
+    return strcmp(a->title, b->title) == 0 && strcmp(a->artist, b->artist) == 0 &&
+           a->duration_sec == b->duration_sec && a->position_sec == b->position_sec &&
+           a->is_playing == b->is_playing;
+}
+
+static void print_state(const char *label, bool ok, const media_state_t *s)
+{
+    fprintf(stderr, "  %-10s %s title='%s' artist='%s' %u/%us %s\n", label, ok ? "ok" : "rejected",
+            s->title, s->artist, (unsigned)s->position_sec, (unsigned)s->duration_sec,
+            s->is_playing ? "playing" : "stopped");
+}
+
+static int check_message(const message_t *m, int index)
+{
+    media_state_t ours = {0};
+    bool ours_ok = media_json_parse(m->json, m->len, &ours);
+    int failed = 0;
+
+    if (m->known && (ours_ok != m->valid || (ours_ok && !same_state(&ours, &m->expect)))) {
+        failed = 1;
+    }
+#if HAVE_CJSON
+    media_state_t ref = {0};
+    bool ref_ok = parse_cjson(m->json, m->len, &ref);
+    if (ours_ok != ref_ok || (ours_ok && !same_state(&ours, &ref))) {
+        failed = 1;
+    }
+#endif
+
+    if (failed) {
+        fprintf(stderr, "FAIL message %d (%zu bytes): %.*s\n", index, m->len, (int)(m->len > 200 ? 200 : m->len), m->json);
+        print_state("media_json", ours_ok, &ours);
+        if (m->known) {
+            print_state("expected", m->valid, &m->expect);
+        }
+#if HAVE_CJSON
+        print_state("cJSON", ref_ok, &ref);
+#endif
+    }
+    return failed;
+}
+
+typedef bool (*parse_fn_t)(const char *data, size_t len, media_state_t *state);
+
+// Parses the messages in [first, last) until min_time has passed; returns seconds per round
+static double time_parser(parse_fn_t parse, const message_t *msgs, int first, int last, double min_time, int *rounds)
+{
+    volatile uint32_t sink = 0;
+    double start = now();
+    double elapsed;
+    int n = 0;
+
+    do {
+        for (int i = first; i < last; i++) {
+            media_state_t state = {0};
+            parse(msgs[i].json, msgs[i].len, &state);
+            sink += state.position_sec;
+        }
+        n++;
+        elapsed = now() - start;
+    } while (elapsed < min_time);
+
+    (void)sink;
+    *rounds = n;
+    return elapsed / n;
+}
+
+static int load_file(const char *path, message_t *m)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    m->json = malloc(MAX_MESSAGE);
+    m->len = fread(m->json, 1, MAX_MESSAGE, f);
+    fclose(f);
+    m->valid = true;
+    m->known = false;
+    return 0;
+}
+
+static int by_length(const void *a, const void *b)
+{
+    const message_t *x = a;
+    const message_t *y = b;
+    return (x->len > y->len) - (x->len < y->len);
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-t seconds] [-n messages] [file.json ...]\n", argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    double min_time = 0.2;
+    int synth = 200;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:n:")) != -1) {
+        switch (opt) {
+            case 't':
+                min_time = atof(optarg);
+                break;
+            case 'n':
+                synth = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    int malformed = sizeof(s_malformed) / sizeof(s_malformed[0]);
+    int files = argc - optind;
+    int count = synth + malformed + files;
+    message_t *msgs = calloc(count, sizeof(message_t));
+    int n = 0;
+
+    for (int i = 0; i < synth; i++) {
+        synth_message(&msgs[n++], i + 1);
+    }
+    for (int i = optind; i < argc; i++) {
+        if (load_file(argv[i], &msgs[n]) == 0) {
+            n++;
+        }
+    }
+
+    // Conformance, including the malformed messages
+    int failed = 0;
+    for (int i = 0; i < n; i++) {
+        failed += check_message(&msgs[i], i);
+    }
+    for (int i = 0; i < malformed; i++) {
+        message_t m = { .json = (char *)s_malformed[i], .len = strlen(s_malformed[i]), .valid = false, .known = true };
+        failed += check_message(&m, n + i);
+    }
+
+#if HAVE_CJSON
+    cJSON_Hooks hooks = { .malloc_fn = counting_malloc, .free_fn = free };
+    cJSON_InitHooks(&hooks);
+#else
+    printf("cJSON not built in; timing media_json only\n");
+#endif
+
+    // Timing by size class: the state messages the firmware sees most are the short ones
+    qsort(msgs, n, sizeof(message_t), by_length);
+    int classes[4] = { 0, n / 3, 2 * n / 3, n };
+    printf("%-10s %12s %10s %9s %10s %9s %9s\n", "size", "parser", "ns/msg", "MB/s", "allocs", "bytes", "speedup");
+    for (int c = 0; c < 3; c++) {
+        int first = classes[c];
+        int last = classes[c + 1];
+        if (first == last) {
+            continue;
+        }
+        size_t bytes = 0;
+        for (int i = first; i < last; i++) {
+            bytes += msgs[i].len;
+        }
+        int count_msgs = last - first;
+        char label[32];
+        snprintf(label, sizeof(label), "%zu-%zu", msgs[first].len, msgs[last - 1].len);
+
+        int rounds;
+        double ours = time_parser(media_json_parse, msgs, first, last, min_time, &rounds);
+        printf("%-10s %12s %10.0f %9.1f %10.1f %9.0f %9s\n", label, "media_json", ours * 1e9 / count_msgs,
+               bytes / ours / 1e6, 0.0, 0.0, "");
+#if HAVE_CJSON
+        s_allocs = 0;
+        s_alloc_bytes = 0;
+        double ref = time_parser(parse_cjson, msgs, first, last, min_time, &rounds);
+        double per = (double)count_msgs * rounds;
+        printf("%-10s %12s %10.0f %9.1f %10.1f %9.0f %8.1fx\n", "", "cJSON", ref * 1e9 / count_msgs,
+               bytes / ref / 1e6, s_allocs / per, s_alloc_bytes / per, ref / ours);
+#endif
+    }
+
+    printf("%d messages, %d malformed, %d failed\n", n, malformed, failed);
+    return failed ? 1 : 0;
+}
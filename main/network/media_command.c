@@ -0,0 +1,25 @@
+#include "media_command.h"
+#include "mqtt_handler.h"
+#include "media_players.h"
+
+// {"command": "<name>", "data": null}, as cJSON_PrintUnformatted() used to produce it
+#define CMD_PAYLOAD(name) "{\"command\":\"" name "\",\"data\":null}"
+#define CMD(name) { CMD_PAYLOAD(name), sizeof(CMD_PAYLOAD(name)) - 1 }
+
+static const struct {
+    const char *payload;
+    int len;
+} s_commands[MEDIA_CMD_COUNT] = {
+    [MEDIA_CMD_PLAY] = CMD("play"),
+    [MEDIA_CMD_PAUSE] = CMD("pause"),
+    [MEDIA_CMD_PREVIOUS] = CMD("previous"),
+    [MEDIA_CMD_NEXT] = CMD("next"),
+};
+
+esp_err_t media_command_send(media_cmd_t cmd)
+{
+    if (cmd < 0 || cmd >= MEDIA_CMD_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return mqtt_handler_publish(media_players_cmd_topic(), s_commands[cmd].payload, s_commands[cmd].len, 0, 0);
+}
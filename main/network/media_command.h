@@ -0,0 +1,26 @@
+#ifndef MEDIA_COMMAND_H
+#define MEDIA_COMMAND_H
+
+#include "esp_err.h"
+
+// Commands understood by the media player's command topic
+typedef enum {
+    MEDIA_CMD_PLAY = 0,
+    MEDIA_CMD_PAUSE,
+    MEDIA_CMD_PREVIOUS,
+    MEDIA_CMD_NEXT,
+    MEDIA_CMD_COUNT
+} media_cmd_t;
+
+/**
+ * @brief Publish a command to the media player
+ *
+ * Payloads are compile-time constants, so this allocates nothing and can be
+ * called straight from an LVGL event handler.
+ *
+ * @param cmd Command to send
+ * @return esp_err_t ESP_OK if handed to the MQTT client
+ */
+esp_err_t media_command_send(media_cmd_t cmd);
+
+#endif // MEDIA_COMMAND_H
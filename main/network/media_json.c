@@ -0,0 +1,376 @@
+#include "media_json.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define JSON_MAX_DEPTH 32       // Nesting of skipped values; Home Assistant sends a few levels at most
+#define JSON_MAX_NUMBER 63      // Longest number token accepted
+#define JSON_MAX_KEY 16         // Longer keys can't be one of ours
+
+// Fields taken from the message; the first occurrence of each wins
+typedef enum {
+    FIELD_NONE = 0,
+    FIELD_TITLE,
+    FIELD_ARTIST,
+    FIELD_DURATION,
+    FIELD_POSITION,
+    FIELD_STATE,
+} media_field_t;
+
+static const struct {
+    const char *key;
+    media_field_t field;
+} s_fields[] = {
+    { "title", FIELD_TITLE },
+    { "artist", FIELD_ARTIST },
+    { "duration", FIELD_DURATION },
+    { "currentposition", FIELD_POSITION },
+    { "state", FIELD_STATE },
+};
+
+typedef struct {
+    const char *p;
+    const char *end;
+} json_cursor_t;
+
+static void skip_space(json_cursor_t *c)
+{
+    while (c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\n' || *c->p == '\r')) {
+        c->p++;
+    }
+}
+
+static bool consume(json_cursor_t *c, char ch)
+{
+    skip_space(c);
+    if (c->p < c->end && *c->p == ch) {
+        c->p++;
+        return true;
+    }
+    return false;
+}
+
+static int hex_value(char ch)
+{
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+    }
+    if (ch >= 'a' && ch <= 'f') {
+        return ch - 'a' + 10;
+    }
+    if (ch >= 'A' && ch <= 'F') {
+        return ch - 'A' + 10;
+    }
+    return -1;
+}
+
+static bool parse_hex4(json_cursor_t *c, uint32_t *value)
+{
+    if (c->end - c->p < 4) {
+        return false;
+    }
+    *value = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = hex_value(c->p[i]);
+        if (digit < 0) {
+            return false;
+        }
+        *value = (*value << 4) | digit;
+    }
+    c->p += 4;
+    return true;
+}
+
+// Appends one byte if it fits; len keeps counting so callers can tell truncated strings apart
+static void put_byte(char *out, size_t out_size, size_t *len, char ch)
+{
+    if (out != NULL && *len + 1 < out_size) {
+        out[*len] = ch;
+    }
+    (*len)++;
+}
+
+// Reads a string at the cursor, unescaped and NUL-terminated into out (truncated to out_size - 1
+// bytes; out may be NULL to skip it). *len receives the full unescaped length.
+static bool parse_string(json_cursor_t *c, char *out, size_t out_size, size_t *len)
+{
+    size_t n = 0;
+
+    if (!consume(c, '"')) {
+        return false;
+    }
+
+    while (c->p < c->end && *c->p != '"') {
+        char ch = *c->p++;
+        if (ch != '\\') {
+            put_byte(out, out_size, &n, ch);
+            continue;
+        }
+
+        if (c->p >= c->end) {
+            return false;
+        }
+        ch = *c->p++;
+        switch (ch) {
+            case '"':
+            case '\\':
+            case '/':
+                put_byte(out, out_size, &n, ch);
+                break;
+            case 'b':
+                put_byte(out, out_size, &n, '\b');
+                break;
+            case 'f':
+                put_byte(out, out_size, &n, '\f');
+                break;
+            case 'n':
+                put_byte(out, out_size, &n, '\n');
+                break;
+            case 'r':
+                put_byte(out, out_size, &n, '\r');
+                break;
+            case 't':
+                put_byte(out, out_size, &n, '\t');
+                break;
+            case 'u': {
+                uint32_t cp;
+                if (!parse_hex4(c, &cp) || (cp >= 0xDC00 && cp <= 0xDFFF)) {
+                    return false;
+                }
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    // UTF-16 surrogate pair
+                    uint32_t low;
+                    if (c->end - c->p < 2 || c->p[0] != '\\' || c->p[1] != 'u') {
+                        return false;
+                    }
+                    c->p += 2;
+                    if (!parse_hex4(c, &low) || low < 0xDC00 || low > 0xDFFF) {
+                        return false;
+                    }
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+
+                // UTF-8
+                if (cp < 0x80) {
+                    put_byte(out, out_size, &n, cp);
+                } else if (cp < 0x800) {
+                    put_byte(out, out_size, &n, 0xC0 | (cp >> 6));
+                    put_byte(out, out_size, &n, 0x80 | (cp & 0x3F));
+                } else if (cp < 0x10000) {
+                    put_byte(out, out_size, &n, 0xE0 | (cp >> 12));
+                    put_byte(out, out_size, &n, 0x80 | ((cp >> 6) & 0x3F));
+                    put_byte(out, out_size, &n, 0x80 | (cp & 0x3F));
+                } else {
+                    put_byte(out, out_size, &n, 0xF0 | (cp >> 18));
+                    put_byte(out, out_size, &n, 0x80 | ((cp >> 12) & 0x3F));
+                    put_byte(out, out_size, &n, 0x80 | ((cp >> 6) & 0x3F));
+                    put_byte(out, out_size, &n, 0x80 | (cp & 0x3F));
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+
+    if (c->p >= c->end) {
+        return false;  // Unterminated
+    }
+    c->p++;
+
+    if (out != NULL && out_size > 0) {
+        out[n < out_size ? n : out_size - 1] = '\0';
+    }
+    if (len != NULL) {
+        *len = n;
+    }
+    return true;
+}
+
+static bool parse_number(json_cursor_t *c, double *value)
+{
+    char buf[JSON_MAX_NUMBER + 1];
+    size_t n = 0;
+
+    skip_space(c);
+    while (c->p < c->end && ((*c->p >= '0' && *c->p <= '9') || *c->p == '-' || *c->p == '+' ||
+                             *c->p == '.' || *c->p == 'e' || *c->p == 'E')) {
+        if (n == JSON_MAX_NUMBER) {
+            return false;
+        }
+        buf[n++] = *c->p++;
+    }
+    if (n == 0) {
+        return false;
+    }
+    buf[n] = '\0';
+
+    char *end;
+    *value = strtod(buf, &end);
+    return end == buf + n;
+}
+
+static bool parse_literal(json_cursor_t *c, const char *literal)
+{
+    size_t len = strlen(literal);
+    if ((size_t)(c->end - c->p) < len || memcmp(c->p, literal, len) != 0) {
+        return false;
+    }
+    c->p += len;
+    return true;
+}
+
+static bool skip_value(json_cursor_t *c, int depth);
+
+// Walks an object or array after its opening bracket
+static bool skip_container(json_cursor_t *c, char close, int depth)
+{
+    if (depth >= JSON_MAX_DEPTH) {
+        return false;
+    }
+    if (consume(c, close)) {
+        return true;
+    }
+    do {
+        if (close == '}' && (!parse_string(c, NULL, 0, NULL) || !consume(c, ':'))) {
+            return false;
+        }
+        if (!skip_value(c, depth + 1)) {
+            return false;
+        }
+    } while (consume(c, ','));
+    return consume(c, close);
+}
+
+static bool skip_value(json_cursor_t *c, int depth)
+{
+    double number;
+
+    skip_space(c);
+    if (c->p >= c->end) {
+        return false;
+    }
+    switch (*c->p) {
+        case '"':
+            return parse_string(c, NULL, 0, NULL);
+        case '{':
+            c->p++;
+            return skip_container(c, '}', depth);
+        case '[':
+            c->p++;
+            return skip_container(c, ']', depth);
+        case 't':
+            return parse_literal(c, "true");
+        case 'f':
+            return parse_literal(c, "false");
+        case 'n':
+            return parse_literal(c, "null");
+        default:
+            return parse_number(c, &number);
+    }
+}
+
+// Seconds as sent by Home Assistant (may be fractional), saturated to the field
+static uint32_t to_seconds(double value)
+{
+    if (!(value > 0)) {
+        return 0;
+    }
+    if (value >= (double)UINT32_MAX) {
+        return UINT32_MAX;
+    }
+    return (uint32_t)value;
+}
+
+static media_field_t lookup_field(const char *key, size_t len)
+{
+    for (size_t i = 0; i < sizeof(s_fields) / sizeof(s_fields[0]); i++) {
+        if (strlen(s_fields[i].key) == len && memcmp(s_fields[i].key, key, len) == 0) {
+            return s_fields[i].field;
+        }
+    }
+    return FIELD_NONE;
+}
+
+// Reads the value of one of our fields; values of another type are skipped
+static bool parse_field(json_cursor_t *c, media_field_t field, media_state_t *state)
+{
+    skip_space(c);
+    if (c->p >= c->end) {
+        return false;
+    }
+
+    switch (field) {
+        case FIELD_TITLE:
+            if (*c->p == '"') {
+                return parse_string(c, state->title, sizeof(state->title), NULL);
+            }
+            break;
+        case FIELD_ARTIST:
+            if (*c->p == '"') {
+                return parse_string(c, state->artist, sizeof(state->artist), NULL);
+            }
+            break;
+        case FIELD_STATE:
+            if (*c->p == '"') {
+                char value[8];
+                size_t len;
+                if (!parse_string(c, value, sizeof(value), &len)) {
+                    return false;
+                }
+                state->is_playing = (len == 7 && memcmp(value, "playing", 7) == 0);
+                return true;
+            }
+            break;
+        case FIELD_DURATION:
+        case FIELD_POSITION:
+            if (*c->p == '-' || (*c->p >= '0' && *c->p <= '9')) {
+                double value;
+                if (!parse_number(c, &value)) {
+                    return false;
+                }
+                if (field == FIELD_DURATION) {
+                    state->duration_sec = to_seconds(value);
+                } else {
+                    state->position_sec = to_seconds(value);
+                }
+                return true;
+            }
+            break;
+        default:
+            break;
+    }
+    return skip_value(c, 1);
+}
+
+bool media_json_parse(const char *json, size_t len, media_state_t *state)
+{
+    json_cursor_t c = { .p = json, .end = json + len };
+    uint32_t seen = 0;
+
+    if (json == NULL || !consume(&c, '{')) {
+        return false;
+    }
+    if (consume(&c, '}')) {
+        return true;
+    }
+
+    do {
+        char key[JSON_MAX_KEY];
+        size_t key_len;
+        if (!parse_string(&c, key, sizeof(key), &key_len) || !consume(&c, ':')) {
+            return false;
+        }
+
+        media_field_t field = key_len < sizeof(key) ? lookup_field(key, key_len) : FIELD_NONE;
+        if (field != FIELD_NONE && (seen & (1U << field)) == 0) {
+            seen |= 1U << field;
+            if (!parse_field(&c, field, state)) {
+                return false;
+            }
+        } else if (!skip_value(&c, 1)) {
+            return false;
+        }
+    } while (consume(&c, ','));
+
+    return consume(&c, '}');
+}
@@ -0,0 +1,23 @@
+#ifndef MEDIA_JSON_H
+#define MEDIA_JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "ui/media_state.h"
+
+/**
+ * @brief Extract the media state from a Home Assistant state message
+ *
+ * Scans the JSON once without allocating and writes "title", "artist", "duration",
+ * "currentposition" and "state" of the top-level object straight into state; every
+ * other key is skipped. Fields that are missing or have the wrong type are left as
+ * they are, so clear state first. Strings longer than the fields are truncated.
+ *
+ * @param json Message payload (need not be NUL-terminated)
+ * @param len Length of the payload
+ * @param state Receives the fields found
+ * @return true if the payload is a JSON object, false if it is malformed
+ */
+bool media_json_parse(const char *json, size_t len, media_state_t *state);
+
+#endif // MEDIA_JSON_H
@@ -0,0 +1,289 @@
+#include "media_players.h"
+#include "app_config.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "ui/ui_media.h"
+#include "ui/thumbnail.h"
+
+static const char *TAG = "media_players";
+
+#define PLAYER_ID_MAX 32                    // Longest player id, including the NUL
+#define PLAYER_TOPIC_MAX (sizeof(MQTT_PLAYER_PREFIX) + PLAYER_ID_MAX + 16)
+#define PLAYER_ART_BUDGET (16 * 1024)       // All kept thumbnails together; the rest are shown but not kept
+#define ROUTE_SLOTS 16                      // Power of two, at least twice the routes
+#define ROUTE_COUNT (MQTT_PLAYER_MAX * 2)
+
+_Static_assert(ROUTE_SLOTS >= 2 * ROUTE_COUNT && (ROUTE_SLOTS & (ROUTE_SLOTS - 1)) == 0,
+               "ROUTE_SLOTS must be a power of two with room for every route");
+
+typedef struct {
+    char id[PLAYER_ID_MAX];
+    char cmd_topic[PLAYER_TOPIC_MAX];
+    bool has_state;
+    media_state_t state;                    // Last state received
+    int64_t state_time_us;                  // When it was received, to advance the position on a switch
+    uint8_t *art;                           // Last complete thumbnail
+    size_t art_len;
+    uint8_t *rx;                            // Thumbnail being received
+    size_t rx_len;
+} media_player_t;
+
+// Open addressing on the FNV-1a hash of the full topic
+typedef struct {
+    uint32_t hash;
+    uint8_t used;
+    uint8_t player;
+    uint8_t kind;
+    uint8_t len;
+    char topic[PLAYER_TOPIC_MAX];
+} route_t;
+
+static const char *s_suffixes[] = {
+    [MEDIA_TOPIC_STATE] = MQTT_PLAYER_STATE,
+    [MEDIA_TOPIC_THUMB] = MQTT_PLAYER_THUMB,
+};
+
+static media_player_t s_players[MQTT_PLAYER_MAX];
+static int s_count = 0;
+static int s_selected = 0;
+static size_t s_art_bytes = 0;              // Held in art and rx buffers, up to PLAYER_ART_BUDGET
+static route_t s_routes[ROUTE_SLOTS];       // Written by the MQTT task only
+static SemaphoreHandle_t s_lock = NULL;     // Guards s_players, s_count and s_selected
+static bool s_full_logged = false;          // Unknown players are retried on every message; log once
+
+static uint32_t topic_hash(const char *topic, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)topic[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void route_add(const char *topic, int player, media_topic_t kind)
+{
+    size_t len = strlen(topic);
+    uint32_t hash = topic_hash(topic, len);
+
+    for (uint32_t i = 0; i < ROUTE_SLOTS; i++) {
+        route_t *r = &s_routes[(hash + i) & (ROUTE_SLOTS - 1)];
+        if (!r->used) {
+            r->hash = hash;
+            r->player = player;
+            r->kind = kind;
+            r->len = len;
+            memcpy(r->topic, topic, len + 1);
+            r->used = 1;
+            return;
+        }
+    }
+}
+
+// Adds a player and its routes; call with s_lock held
+static int player_add(const char *id, size_t id_len)
+{
+    if (s_count >= MQTT_PLAYER_MAX || id_len == 0 || id_len >= PLAYER_ID_MAX) {
+        return -1;
+    }
+
+    int index = s_count;
+    media_player_t *p = &s_players[index];
+    memset(p, 0, sizeof(*p));
+    memcpy(p->id, id, id_len);
+    snprintf(p->cmd_topic, sizeof(p->cmd_topic), "%s%s%s", MQTT_PLAYER_PREFIX, p->id, MQTT_PLAYER_CMD);
+
+    for (int kind = 0; kind < (int)(sizeof(s_suffixes) / sizeof(s_suffixes[0])); kind++) {
+        char topic[PLAYER_TOPIC_MAX];
+        snprintf(topic, sizeof(topic), "%s%s%s", MQTT_PLAYER_PREFIX, p->id, s_suffixes[kind]);
+        route_add(topic, index, kind);
+    }
+
+    s_count++;
+    ESP_LOGI(TAG, "Player %d: %s", index, p->id);
+    return index;
+}
+
+esp_err_t media_players_init(void)
+{
+    if (s_lock == NULL) {
+        s_lock = xSemaphoreCreateMutex();
+        if (s_lock == NULL) {
+            ESP_LOGE(TAG, "Failed to create mutex");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_count == 0) {
+        player_add(MQTT_PLAYER_DEFAULT, strlen(MQTT_PLAYER_DEFAULT));
+        s_selected = 0;
+    }
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+// MQTT_PLAYER_PREFIX "<id>" followed by one of the suffixes; adds the player if there is room
+static int discover(const char *topic, size_t len, media_topic_t *kind)
+{
+    size_t prefix_len = sizeof(MQTT_PLAYER_PREFIX) - 1;
+    if (len <= prefix_len || memcmp(topic, MQTT_PLAYER_PREFIX, prefix_len) != 0) {
+        return -1;
+    }
+
+    const char *id = topic + prefix_len;
+    const char *slash = memchr(id, '/', len - prefix_len);
+    if (slash == NULL) {
+        return -1;
+    }
+
+    size_t rest = topic + len - slash;
+    for (int k = 0; k < (int)(sizeof(s_suffixes) / sizeof(s_suffixes[0])); k++) {
+        if (strlen(s_suffixes[k]) == rest && memcmp(slash, s_suffixes[k], rest) == 0) {
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            int player = player_add(id, slash - id);
+            xSemaphoreGive(s_lock);
+            if (player < 0) {
+                if (!s_full_logged) {
+                    ESP_LOGW(TAG, "Ignoring player '%.*s' (table full or id too long)", (int)(slash - id), id);
+                    s_full_logged = true;
+                }
+                return -1;
+            }
+            *kind = k;
+            return player;
+        }
+    }
+    return -1;
+}
+
+int media_players_route(const char *topic, size_t len, media_topic_t *kind)
+{
+    uint32_t hash = topic_hash(topic, len);
+
+    for (uint32_t i = 0; i < ROUTE_SLOTS; i++) {
+        const route_t *r = &s_routes[(hash + i) & (ROUTE_SLOTS - 1)];
+        if (!r->used) {
+            break;
+        }
+        if (r->hash == hash && r->len == len && memcmp(r->topic, topic, len) == 0) {
+            *kind = r->kind;
+            return r->player;
+        }
+    }
+
+    return discover(topic, len, kind);
+}
+
+void media_players_set_state(int player, const media_state_t *state)
+{
+    if (player < 0 || player >= MQTT_PLAYER_MAX) {
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    media_player_t *p = &s_players[player];
+    p->state = *state;
+    p->state_time_us = esp_timer_get_time();
+    p->has_state = true;
+    if (player == s_selected) {
+        // Under the lock, so a player switch can't slip in between
+        ui_media_update_state(state);
+    }
+    xSemaphoreGive(s_lock);
+}
+
+// Frees a thumbnail buffer; call with s_lock held
+static void art_free(uint8_t **buf, size_t *len)
+{
+    free(*buf);
+    s_art_bytes -= *len;
+    *buf = NULL;
+    *len = 0;
+}
+
+void media_players_thumb_feed(int player, const uint8_t *data, size_t len, size_t offset, size_t total_len)
+{
+    if (player < 0 || player >= MQTT_PLAYER_MAX) {
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    media_player_t *p = &s_players[player];
+
+    if (offset == 0) {
+        // New image: the previous one is outdated whether or not this one can be kept
+        art_free(&p->rx, &p->rx_len);
+        art_free(&p->art, &p->art_len);
+        if (s_art_bytes + total_len <= PLAYER_ART_BUDGET) {
+            p->rx = heap_caps_malloc(total_len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+            if (p->rx == NULL) {
+                p->rx = malloc(total_len);
+            }
+        }
+        if (p->rx != NULL) {
+            p->rx_len = total_len;
+            s_art_bytes += total_len;
+        } else {
+            ESP_LOGW(TAG, "Thumbnail of %s not kept (%zu bytes)", p->id, total_len);
+        }
+    }
+
+    if (p->rx != NULL && offset + len <= p->rx_len) {
+        memcpy(p->rx + offset, data, len);
+        if (offset + len == p->rx_len) {
+            p->art = p->rx;
+            p->art_len = p->rx_len;
+            p->rx = NULL;
+            p->rx_len = 0;
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    // Decoded only if the player is displayed; thumbnail_show() on a switch settles any race with this
+    thumbnail_feed(player, data, len, offset, total_len);
+}
+
+void media_players_select_next(void)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_count < 2) {
+        xSemaphoreGive(s_lock);
+        return;
+    }
+
+    s_selected = (s_selected + 1) % s_count;
+    media_player_t *p = &s_players[s_selected];
+
+    media_state_t state = p->state;
+    if (!p->has_state) {
+        snprintf(state.title, sizeof(state.title), "%s", p->id);
+        snprintf(state.artist, sizeof(state.artist), "Waiting for data...");
+    } else if (state.is_playing) {
+        // Players report on changes only, so the stored position may be minutes old
+        int64_t elapsed = (esp_timer_get_time() - p->state_time_us) / 1000000;
+        uint64_t position = state.position_sec + (uint64_t)(elapsed > 0 ? elapsed : 0);
+        if (state.duration_sec > 0 && position > state.duration_sec) {
+            position = state.duration_sec;
+        }
+        state.position_sec = position > UINT32_MAX ? UINT32_MAX : (uint32_t)position;
+    }
+    ui_media_update_state(&state);
+
+    // Copies the art for the thumbnail task; no decoding here (this runs in the LVGL task)
+    thumbnail_show(s_selected, p->art, p->art_len);
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGI(TAG, "Showing player %d: %s", s_selected, p->id);
+}
+
+const char *media_players_cmd_topic(void)
+{
+    // Topics never change once a player is added, and s_selected is a single word
+    return s_players[s_selected].cmd_topic;
+}
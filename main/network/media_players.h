@@ -0,0 +1,83 @@
+#ifndef MEDIA_PLAYERS_H
+#define MEDIA_PLAYERS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "ui/media_state.h"
+
+// Per-player topics below MQTT_PLAYER_PREFIX "<id>"
+typedef enum {
+    MEDIA_TOPIC_STATE = 0,
+    MEDIA_TOPIC_THUMB,
+} media_topic_t;
+
+/**
+ * @brief Set up the player table with MQTT_PLAYER_DEFAULT as the displayed player
+ *
+ * Further players are added as their topics first show up (see media_players_route()),
+ * up to MQTT_PLAYER_MAX. Each keeps its last state and thumbnail in memory, so switching
+ * the displayed player needs no broker round trip.
+ *
+ * Heap: kept thumbnails (compressed) share a 16 KB budget; one that doesn't fit is only shown.
+ * The displayed player's image is also copied into one of thumbnail.c's two 20 KB buffers while
+ * it decodes, so the worst case is 16 KB here on top of those 40 KB and the decoded frames.
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t media_players_init(void);
+
+/**
+ * @brief Look up which player and topic a message belongs to
+ *
+ * Hashed lookup; an unknown topic of the form MQTT_PLAYER_PREFIX "<id>/<topic>" adds the
+ * player if there is room. Call from the MQTT task only.
+ *
+ * @param topic Topic of the message (need not be NUL-terminated)
+ * @param len Length of the topic
+ * @param kind Receives the topic
+ * @return int Player index, -1 if the topic is not a player topic
+ */
+int media_players_route(const char *topic, size_t len, media_topic_t *kind);
+
+/**
+ * @brief Store a player's new state, showing it if the player is displayed
+ *
+ * @param player Index from media_players_route()
+ * @param state Parsed state
+ */
+void media_players_set_state(int player, const media_state_t *state);
+
+/**
+ * @brief Push one fragment of a player's thumbnail message
+ *
+ * The complete image is kept for when the player is displayed (the previous one is dropped
+ * as soon as a new one starts); for the displayed player it is also decoded as it arrives
+ * (see thumbnail_feed()). Call from the MQTT task only.
+ *
+ * @param player Index from media_players_route()
+ * @param data Fragment data (only valid during the call)
+ * @param len Length of the fragment
+ * @param offset Offset of the fragment in the message
+ * @param total_len Total length of the message
+ */
+void media_players_thumb_feed(int player, const uint8_t *data, size_t len, size_t offset, size_t total_len);
+
+/**
+ * @brief Display the next known player, with its stored state and thumbnail
+ *
+ * A playing player's position is advanced by the time since its last state. The thumbnail
+ * is decoded by the thumbnail task, so this is safe to call from any task (e.g. an LVGL
+ * event handler).
+ */
+void media_players_select_next(void);
+
+/**
+ * @brief Command topic of the displayed player
+ *
+ * @return const char* NUL-terminated topic, valid for the lifetime of the program
+ */
+const char *media_players_cmd_topic(void);
+
+#endif // MEDIA_PLAYERS_H
@@ -3,8 +3,8 @@
 #include "esp_log.h"
 #include "esp_event.h"
 #include "mqtt_client.h"  // ESP-IDF MQTT client header
-#include "cJSON.h"
-#include "ui/ui_media.h"
+#include "media_json.h"
+#include "media_players.h"
 #include <string.h>
 #include <inttypes.h>
 
@@ -13,60 +13,19 @@ static const char *TAG = "mqtt_handler";
 static esp_mqtt_client_handle_t s_mqtt_client = NULL;
 static bool s_is_connected = false;
 
-// Buffer for assembling fragmented thumbnail messages
-// Note: This buffer is provided by ui_media to avoid duplicate allocation
-static uint8_t *s_thumb_buffer = NULL;
-static size_t s_thumb_buffer_size = 0;
-static int s_thumb_offset = 0;
-static int s_thumb_total_len = 0;
-static bool s_receiving_thumb = false;
+// Player and topic of the message being received; esp-mqtt only sends the topic with the first fragment
+static int s_msg_player = -1;
+static media_topic_t s_msg_kind = MEDIA_TOPIC_STATE;
 
-// Track current topic for fragmented messages
-typedef enum {
-    CURRENT_TOPIC_NONE = 0,
-    CURRENT_TOPIC_STATE,
-    CURRENT_TOPIC_THUMB
-} current_topic_t;
-
-static current_topic_t s_current_topic = CURRENT_TOPIC_NONE;
-
-static void parse_media_state(const char *data, int data_len)
+static void parse_media_state(int player, const char *data, int data_len)
 {
-    // Parse JSON
-    cJSON *json = cJSON_ParseWithLength(data, data_len);
-    if (json == NULL) {
+    // Single pass over the payload, no allocations
+    media_state_t state = {0};
+    if (!media_json_parse(data, data_len, &state)) {
         ESP_LOGW(TAG, "Failed to parse JSON (%d bytes)", data_len);
         return;
     }
     
-    // Extract fields
-    media_state_t state = {0};
-    
-    cJSON *title = cJSON_GetObjectItem(json, "title");
-    if (title && cJSON_IsString(title)) {
-        strncpy(state.title, title->valuestring, sizeof(state.title) - 1);
-    }
-    
-    cJSON *artist = cJSON_GetObjectItem(json, "artist");
-    if (artist && cJSON_IsString(artist)) {
-        strncpy(state.artist, artist->valuestring, sizeof(state.artist) - 1);
-    }
-    
-    cJSON *duration = cJSON_GetObjectItem(json, "duration");
-    if (duration && cJSON_IsNumber(duration)) {
-        state.duration_sec = (uint32_t)duration->valuedouble;
-    }
-    
-    cJSON *position = cJSON_GetObjectItem(json, "currentposition");
-    if (position && cJSON_IsNumber(position)) {
-        state.position_sec = (uint32_t)position->valuedouble;
-    }
-    
-    cJSON *play_state = cJSON_GetObjectItem(json, "state");
-    if (play_state && cJSON_IsString(play_state)) {
-        state.is_playing = (strcmp(play_state->valuestring, "playing") == 0);
-    }
-    
     // Only update if we have a title (valid data)
     if (strlen(state.title) > 0) {
         ESP_LOGI(TAG, "Media: '%s' by '%s' [%s] (%" PRIu32 "/%" PRIu32 "s)", 
@@ -74,11 +33,9 @@ static void parse_media_state(const char *data, int data_len)
                  state.is_playing ? "playing" : "paused",
                  state.position_sec, state.duration_sec);
         
-        // Update UI
-        ui_media_update_state(&state);
+        // Kept per player; applied by the LVGL task if the player is displayed
+        media_players_set_state(player, &state);
     }
-    
-    cJSON_Delete(json);
 }
 
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, 
@@ -91,28 +48,14 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
             ESP_LOGI(TAG, "MQTT connected to broker");
             s_is_connected = true;
             
-            // Check if thumbnail buffer was set by UI
-            if (s_thumb_buffer == NULL) {
-                ESP_LOGW(TAG, "Thumbnail buffer not set - thumbnails will be ignored");
-            }
-            
-            // Subscribe to media state topic
-            int msg_id = esp_mqtt_client_subscribe(s_mqtt_client, MQTT_TOPIC_STATE, 0);
-            ESP_LOGI(TAG, "Subscribed to %s, msg_id=%d", MQTT_TOPIC_STATE, msg_id);
+            // Subscribe to the state topic of every media player
+            int msg_id = esp_mqtt_client_subscribe(s_mqtt_client, MQTT_PLAYER_PREFIX "+" MQTT_PLAYER_STATE, 0);
+            ESP_LOGI(TAG, "Subscribed to %s, msg_id=%d", MQTT_PLAYER_PREFIX "+" MQTT_PLAYER_STATE, msg_id);
             
-            // Subscribe to thumbnail topic (only if buffer is available)
-            // NOTE: Thumbnail display disabled due to insufficient RAM for PNG decoding
-            // ESP32-C6 has ~33KB free heap, but PNG decode needs 300-400KB
-            // To enable: Use JPEG thumbnails OR reduce thumbnail size to <100x100
-            #if 1  // Disabled thumbnail subscription
-            if (s_thumb_buffer != NULL) {
-                msg_id = esp_mqtt_client_subscribe(s_mqtt_client, MQTT_TOPIC_THUMB, 0);
-                ESP_LOGI(TAG, "Subscribed to %s, msg_id=%d", MQTT_TOPIC_THUMB, msg_id);
-            }
-            #else
-            ESP_LOGW(TAG, "Thumbnail display disabled - insufficient RAM for PNG decode");
-            ESP_LOGI(TAG, "To enable: Switch to JPEG or reduce thumbnail size to <100x100 pixels");
-            #endif
+            // Subscribe to the thumbnail topic of every media player
+            // The displayed player's art decodes while its fragments arrive; every player's is kept for switching
+            msg_id = esp_mqtt_client_subscribe(s_mqtt_client, MQTT_PLAYER_PREFIX "+" MQTT_PLAYER_THUMB, 0);
+            ESP_LOGI(TAG, "Subscribed to %s, msg_id=%d", MQTT_PLAYER_PREFIX "+" MQTT_PLAYER_THUMB, msg_id);
             
             // Request initial state by publishing to a status request topic (if your broker supports it)
             // Or just wait for the next state update
@@ -122,8 +65,7 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGW(TAG, "MQTT disconnected");
             s_is_connected = false;
-            s_current_topic = CURRENT_TOPIC_NONE;
-            s_receiving_thumb = false;
+            s_msg_player = -1;
             break;
             
         case MQTT_EVENT_SUBSCRIBED:
@@ -143,20 +85,13 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
                 memcpy(topic_str, event->topic, copy_len);
                 ESP_LOGI(TAG, "Received message on topic: '%s' (%d bytes)", topic_str, event->data_len);
                 
-                // New message with topic
-                if (strncmp(event->topic, MQTT_TOPIC_THUMB, event->topic_len) == 0) {
-                    // New thumbnail - always accept and reset
-                    s_current_topic = CURRENT_TOPIC_THUMB;
-                    s_thumb_offset = 0;
-                    s_thumb_total_len = event->total_data_len;
-                    s_receiving_thumb = true;
-                    ESP_LOGI(TAG, "Starting thumbnail reception: %d bytes total", s_thumb_total_len);
-                } else if (strncmp(event->topic, MQTT_TOPIC_STATE, event->topic_len) == 0) {
-                    // State message - always process (state messages are small and complete)
-                    s_current_topic = CURRENT_TOPIC_STATE;
-                    ESP_LOGI(TAG, "Received state message: %d bytes (total: %d, offset: %d)", 
-                             event->data_len, event->total_data_len, event->current_data_offset);
-                    
+                // New message: hashed lookup of its player (new players are added on first sight)
+                s_msg_player = media_players_route(event->topic, event->topic_len, &s_msg_kind);
+                if (s_msg_player < 0) {
+                    break;
+                }
+
+                if (s_msg_kind == MEDIA_TOPIC_STATE) {
                     // State messages should be complete in one event
                     if (event->data_len > 0 && event->current_data_offset == 0) {
                         // Log first 100 chars of data for debugging
@@ -165,34 +100,23 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
                         memcpy(preview, event->data, preview_len);
                         ESP_LOGI(TAG, "State data: %s", preview);
                         
-                        parse_media_state(event->data, event->data_len);
+                        parse_media_state(s_msg_player, event->data, event->data_len);
                     }
+                    s_msg_player = -1;
                     break;  // State handled, don't process further
-                } else {
-                    s_current_topic = CURRENT_TOPIC_NONE;
                 }
+                ESP_LOGI(TAG, "Starting thumbnail reception: %d bytes total", event->total_data_len);
             }
             
             // Handle data based on tracked topic (for fragmented messages)
-            if (s_current_topic == CURRENT_TOPIC_THUMB && s_thumb_buffer != NULL && s_receiving_thumb) {
-                // Accumulate thumbnail data
-                int copy_len = event->data_len;
-                if (s_thumb_offset + copy_len > (int)s_thumb_buffer_size) {
-                    copy_len = s_thumb_buffer_size - s_thumb_offset;
-                    ESP_LOGW(TAG, "Thumbnail buffer overflow, truncating");
-                }
-                
-                if (copy_len > 0) {
-                    memcpy(s_thumb_buffer + s_thumb_offset, event->data, copy_len);
-                    s_thumb_offset += copy_len;
-                }
-                
+            if (s_msg_player >= 0 && s_msg_kind == MEDIA_TOPIC_THUMB && event->data_len > 0) {
+                media_players_thumb_feed(s_msg_player, (const uint8_t *)event->data, event->data_len,
+                                         event->current_data_offset, event->total_data_len);
+
                 // Check if complete
-                if (s_thumb_offset >= s_thumb_total_len) {
-                    ESP_LOGI(TAG, "Thumbnail complete: %d bytes received", s_thumb_offset);
-                    ui_media_update_thumbnail(s_thumb_buffer, s_thumb_offset);
-                    s_receiving_thumb = false;
-                    s_current_topic = CURRENT_TOPIC_NONE;
+                if (event->current_data_offset + event->data_len >= event->total_data_len) {
+                    ESP_LOGI(TAG, "Thumbnail complete: %d bytes received", event->total_data_len);
+                    s_msg_player = -1;
                 }
             }
             break;
@@ -252,13 +176,6 @@ bool mqtt_handler_is_connected(void)
     return s_is_connected;
 }
 
-void mqtt_handler_set_thumbnail_buffer(uint8_t *buffer, size_t size)
-{
-    s_thumb_buffer = buffer;
-    s_thumb_buffer_size = size;
-    ESP_LOGI(TAG, "Thumbnail buffer set: %p, size: %zu bytes", buffer, size);
-}
-
 esp_err_t mqtt_handler_publish(const char *topic, const char *data, int len, int qos, int retain)
 {
     if (s_mqtt_client == NULL) {
@@ -25,15 +25,6 @@ esp_err_t mqtt_handler_start(void);
  */
 bool mqtt_handler_is_connected(void);
 
-/**
- * @brief Set the thumbnail buffer for MQTT to use
- * This avoids allocating a separate buffer in MQTT handler
- *
- * @param buffer Pointer to thumbnail buffer
- * @param size Size of the buffer in bytes
- */
-void mqtt_handler_set_thumbnail_buffer(uint8_t *buffer, size_t size);
-
 /**
  * @brief Publish a message to an MQTT topic
  *
@@ -0,0 +1,16 @@
+#ifndef MEDIA_STATE_H
+#define MEDIA_STATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Media state structure
+typedef struct {
+    char title[128];
+    char artist[128];
+    uint32_t duration_sec;  // Total duration in seconds
+    uint32_t position_sec;  // Current position in seconds
+    bool is_playing;
+} media_state_t;
+
+#endif // MEDIA_STATE_H
@@ -0,0 +1,606 @@
+#include "thumbnail.h"
+#include "ui_media.h"
+#include "ui_components.h"
+#include "app_config.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "lvgl.h"
+#include "pngle.h"
+#include "jpeg_decoder.h"
+
+static const char *TAG = "thumbnail";
+
+#define PNG_CARRY_SIZE 64       // Covers a chunk header or IHDR split across two fragments
+#define MAX_DIMENSION 2047      // lv_img_header_t stores w/h in 11 bits
+#define PNG_PREVIEW_PASSES 3    // Adam7 passes that get their own screen refresh
+#define JPEG_MAX_SIZE (20 * 1024)  // Per compressed image; reduce quality or size in Home Assistant if larger
+#define JPEG_BUF_COUNT 2
+
+typedef enum {
+    THUMB_IDLE = 0,
+    THUMB_PNG,                  // Streaming through pngle
+    THUMB_JPEG,                 // Receiving into a buffer for the decode task
+    THUMB_SKIP                  // Ignore the rest of this message
+} thumb_state_t;
+
+static thumb_state_t s_state = THUMB_IDLE;  // MQTT task
+static uint32_t s_stream_seq = 0;           // Image being received (MQTT task)
+
+// Compressed image buffers. Ping-pong: the network fills one while the decode task works on the other.
+// A received image waits in a single slot; a newer one replaces it, so rapid track changes only
+// decode the last image. thumbnail_show() hands over complete images (JPEG or PNG) the same way.
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    uint32_t seq;
+} jpeg_buf_t;
+
+static jpeg_buf_t s_jpeg_bufs[JPEG_BUF_COUNT];
+static portMUX_TYPE s_jpeg_lock = portMUX_INITIALIZER_UNLOCKED;  // Also guards s_seq, s_source, s_blank_seq
+static uint32_t s_seq = 0;              // Newest image, for ui_media_post_thumbnail()
+static int s_source = 0;                // Source whose images are shown
+static uint32_t s_blank_seq = 0;        // Blank frame for the decode task to post, 0 if none
+static uint32_t s_jpeg_free = 0;        // Bit per buffer nobody uses (guarded by s_jpeg_lock)
+static int s_jpeg_pending = -1;         // Received, waiting for the decode task (guarded by s_jpeg_lock)
+static jpeg_buf_t *s_jpeg_rx = NULL;    // Being received (MQTT task)
+static TaskHandle_t s_worker = NULL;
+
+// PNG decoding, by the MQTT task (streamed) or the decode task (thumbnail_show()); guarded by s_png_lock.
+// Frames from outside the stream are posted with the lock held, so a streamed frame is never replaced,
+// and freed by the UI, while rows are being written to it.
+static SemaphoreHandle_t s_png_lock = NULL;
+static pngle_t *s_pngle = NULL;
+static uint8_t s_carry[PNG_CARRY_SIZE];  // Bytes pngle couldn't take yet
+static size_t s_carry_len = 0;
+static bool s_png_done = false;
+static bool s_png_failed = false;
+static bool s_png_stream = false;       // Post the frame as soon as it exists, show rows as they arrive
+static uint32_t s_png_seq = 0;
+static uint8_t *s_png_frame = NULL;
+static uint32_t s_png_w = 0;
+static uint32_t s_png_h = 0;
+
+static bool is_png(const uint8_t *data, size_t len)
+{
+    return len >= 4 && data[0] == 0x89 && data[1] == 0x50 && data[2] == 0x4E && data[3] == 0x47;
+}
+
+static uint32_t current_seq(void)
+{
+    taskENTER_CRITICAL(&s_jpeg_lock);
+    uint32_t seq = s_seq;
+    taskEXIT_CRITICAL(&s_jpeg_lock);
+    return seq;
+}
+
+// Decoded frames are handed to ui_media, which frees them once replaced
+static uint8_t *frame_alloc(size_t size)
+{
+    uint8_t *frame = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (frame == NULL) {
+        frame = malloc(size);
+    }
+    return frame;
+}
+
+static void png_init_cb(pngle_t *pngle, uint32_t w, uint32_t h)
+{
+    uint32_t out_w = w;
+    uint32_t out_h = h;
+    if (h > LCD_V_RES) {
+        out_w = (uint32_t)(((uint64_t)w * LCD_V_RES + h / 2) / h);
+        out_h = LCD_V_RES;
+        if (out_w == 0) {
+            out_w = 1;
+        }
+    }
+    if (out_w > MAX_DIMENSION) {
+        ESP_LOGW(TAG, "PNG too large: %lux%lu", (unsigned long)w, (unsigned long)h);
+        s_png_failed = true;
+        pngle_suspend(pngle);
+        return;
+    }
+
+    size_t frame_size = (size_t)out_w * out_h * sizeof(lv_color_t);
+    uint8_t *frame = frame_alloc(frame_size);
+    if (frame == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %lux%lu frame", (unsigned long)out_w, (unsigned long)out_h);
+        s_png_failed = true;
+        pngle_suspend(pngle);
+        return;
+    }
+    memset(frame, 0, frame_size);
+
+#if LV_COLOR_16_SWAP
+    pngle_set_output_buffer(pngle, PNGLE_PIXEL_FORMAT_RGB565_SWAP, frame, out_w * sizeof(lv_color_t), out_w, out_h);
+#else
+    pngle_set_output_buffer(pngle, PNGLE_PIXEL_FORMAT_RGB565, frame, out_w * sizeof(lv_color_t), out_w, out_h);
+#endif
+    if (out_w != w || out_h != h) {
+        pngle_set_scaling(pngle, out_w, out_h, 0, 0, 0, 0, PNGLE_SCALE_BOX);
+    } else {
+        pngle_set_scaling(pngle, 0, 0, 0, 0, 0, 0, PNGLE_SCALE_NEAREST);
+    }
+
+    s_png_frame = frame;
+    s_png_w = out_w;
+    s_png_h = out_h;
+    if (s_png_stream) {
+        // Show the frame right away; rows appear as their fragments arrive. Nothing newer can
+        // replace it while s_png_lock is held, so the UI keeps the pixels alive while they're written.
+        ui_media_post_thumbnail(frame, out_w, out_h, s_png_seq);
+    }
+
+    ESP_LOGI(TAG, "Streaming PNG %lux%lu -> %lux%lu", (unsigned long)w, (unsigned long)h,
+             (unsigned long)out_w, (unsigned long)out_h);
+}
+
+static void png_pass_cb(pngle_t *pngle, int pass)
+{
+    // Coarse Adam7 previews: the whole image is covered after pass 1
+    if (s_png_stream && pass <= PNG_PREVIEW_PASSES) {
+        ui_media_refresh_thumbnail();
+    }
+}
+
+static void png_done_cb(pngle_t *pngle)
+{
+    s_png_done = true;
+}
+
+// Starts a new image; call with s_png_lock held
+static bool png_begin(uint32_t seq, bool stream)
+{
+    if (s_pngle == NULL) {
+        // Kept across images so its buffers are reused
+        s_pngle = pngle_new();
+        if (s_pngle == NULL) {
+            ESP_LOGE(TAG, "Failed to create PNG decoder");
+            return false;
+        }
+        pngle_set_init_callback(s_pngle, png_init_cb);
+        pngle_set_pass_callback(s_pngle, png_pass_cb);
+        pngle_set_done_callback(s_pngle, png_done_cb);
+        pngle_set_progressive(s_pngle, 1);
+
+        // The RGB565 frame has no alpha: blend transparent art over the screen background instead
+        uint32_t bg = lv_color_to32(COLOR_BG_PRIMARY);
+        const uint8_t matte[3] = { (bg >> 16) & 0xFF, (bg >> 8) & 0xFF, bg & 0xFF };
+        pngle_set_flatten(s_pngle, PNGLE_FLATTEN_COLOR, matte);
+    } else {
+        pngle_reset(s_pngle);
+    }
+
+    // pngle_reset() keeps the previous image's frame, which the UI may have freed since; until
+    // png_init_cb() sets the new one, rows go nowhere
+    pngle_set_output_buffer(s_pngle, PNGLE_PIXEL_FORMAT_RGB565, NULL, 0, 0, 0);
+    pngle_set_scaling(s_pngle, 0, 0, 0, 0, 0, 0, PNGLE_SCALE_NEAREST);
+
+    s_carry_len = 0;
+    s_png_done = false;
+    s_png_failed = false;
+    s_png_stream = stream;
+    s_png_seq = seq;
+    s_png_frame = NULL;
+    return true;
+}
+
+// Feeds one fragment; bytes pngle can't take yet (a chunk header cut by the fragment end) are carried over
+static bool png_feed(const uint8_t *data, size_t len)
+{
+    while (len > 0 && !s_png_failed) {
+        if (s_carry_len > 0) {
+            size_t take = LV_MIN(len, sizeof(s_carry) - s_carry_len);
+            memcpy(s_carry + s_carry_len, data, take);
+
+            int fed = pngle_feed(s_pngle, s_carry, s_carry_len + take);
+            if (fed < 0) {
+                ESP_LOGE(TAG, "PNG decode failed: %s", pngle_error(s_pngle));
+                return false;
+            }
+            if (s_png_failed) {
+                return false;  // png_init_cb() gave up on this image
+            }
+
+            if ((size_t)fed >= s_carry_len) {
+                // The carry is used up; the rest continues from data
+                data += fed - s_carry_len;
+                len -= fed - s_carry_len;
+                s_carry_len = 0;
+                continue;
+            }
+
+            s_carry_len += take - fed;
+            memmove(s_carry, s_carry + fed, s_carry_len);
+            data += take;
+            len -= take;
+            if (fed == 0 && s_carry_len == sizeof(s_carry)) {
+                ESP_LOGE(TAG, "PNG stream stalled");
+                return false;
+            }
+            continue;
+        }
+
+        int fed = pngle_feed(s_pngle, data, len);
+        if (fed < 0) {
+            ESP_LOGE(TAG, "PNG decode failed: %s", pngle_error(s_pngle));
+            return false;
+        }
+        if (s_png_failed) {
+            return false;  // png_init_cb() gave up on this image
+        }
+
+        data += fed;
+        len -= fed;
+        if (len > sizeof(s_carry)) {
+            ESP_LOGE(TAG, "PNG stream stalled");
+            return false;
+        }
+        memcpy(s_carry, data, len);
+        s_carry_len = len;
+        break;
+    }
+
+    return true;
+}
+
+// Takes a buffer to receive into: a received image the decode task hasn't started yet is dropped
+// in favor of the new one, else a free buffer
+static jpeg_buf_t *jpeg_acquire(void)
+{
+    int index = -1;
+
+    taskENTER_CRITICAL(&s_jpeg_lock);
+    if (s_jpeg_pending >= 0) {
+        index = s_jpeg_pending;
+        s_jpeg_pending = -1;
+    } else if (s_jpeg_free != 0) {
+        index = __builtin_ctz(s_jpeg_free);
+        s_jpeg_free &= ~(1U << index);
+    }
+    taskEXIT_CRITICAL(&s_jpeg_lock);
+
+    return index >= 0 ? &s_jpeg_bufs[index] : NULL;
+}
+
+static void jpeg_release(jpeg_buf_t *buf)
+{
+    taskENTER_CRITICAL(&s_jpeg_lock);
+    s_jpeg_free |= 1U << (buf - s_jpeg_bufs);
+    taskEXIT_CRITICAL(&s_jpeg_lock);
+}
+
+// Queues a received image for the decode task, replacing one it hasn't started yet
+static void jpeg_submit(jpeg_buf_t *buf)
+{
+    taskENTER_CRITICAL(&s_jpeg_lock);
+    if (s_jpeg_pending >= 0) {
+        s_jpeg_free |= 1U << s_jpeg_pending;
+    }
+    s_jpeg_pending = buf - s_jpeg_bufs;
+    taskEXIT_CRITICAL(&s_jpeg_lock);
+
+    xTaskNotifyGive(s_worker);
+}
+
+static bool jpeg_begin(size_t total_len)
+{
+    if (total_len > JPEG_MAX_SIZE) {
+        ESP_LOGW(TAG, "JPEG thumbnail too large: %zu bytes (max %d)", total_len, JPEG_MAX_SIZE);
+        return false;
+    }
+    s_jpeg_rx = jpeg_acquire();
+    if (s_jpeg_rx == NULL) {
+        ESP_LOGW(TAG, "No free JPEG buffer, thumbnail dropped");
+        return false;
+    }
+    s_jpeg_rx->len = 0;
+    s_jpeg_rx->seq = s_stream_seq;
+    return true;
+}
+
+// Gives an unfinished JPEG buffer back
+static void jpeg_drop(void)
+{
+    if (s_jpeg_rx != NULL) {
+        jpeg_release(s_jpeg_rx);
+        s_jpeg_rx = NULL;
+    }
+}
+
+// Posts a frame decoded outside the PNG stream; runs in the decode task
+static void post_frame(uint8_t *frame, uint32_t w, uint32_t h, uint32_t seq)
+{
+    xSemaphoreTake(s_png_lock, portMAX_DELAY);
+    ui_media_post_thumbnail(frame, w, h, seq);
+    xSemaphoreGive(s_png_lock);
+}
+
+// A screen background frame, shown while there is no art
+static void post_blank(uint32_t seq)
+{
+    const uint32_t size = 8;
+    uint8_t *frame = frame_alloc(size * size * sizeof(lv_color_t));
+    if (frame == NULL) {
+        return;
+    }
+    lv_color_t *pixels = (lv_color_t *)frame;
+    for (uint32_t i = 0; i < size * size; i++) {
+        pixels[i] = COLOR_BG_PRIMARY;
+    }
+    post_frame(frame, size, size, seq);
+}
+
+// Decodes a complete PNG handed over by thumbnail_show(); runs in the decode task
+static void png_decode(const jpeg_buf_t *buf)
+{
+    xSemaphoreTake(s_png_lock, portMAX_DELAY);
+    // A newer image may be streaming through pngle; this one would be dropped by the UI anyway
+    if (buf->seq == current_seq() && png_begin(buf->seq, false)) {
+        bool ok = png_feed(buf->data, buf->len) && s_png_done;
+        if (ok && s_png_frame != NULL) {
+            ui_media_post_thumbnail(s_png_frame, s_png_w, s_png_h, buf->seq);
+        } else {
+            ESP_LOGW(TAG, "PNG thumbnail not decoded");
+            free(s_png_frame);
+        }
+        s_png_frame = NULL;
+    }
+    xSemaphoreGive(s_png_lock);
+}
+
+// Decodes into a new RGB565 frame and posts it to the UI; runs in the decode task
+static void jpeg_decode(const jpeg_buf_t *buf)
+{
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = buf->data,
+        .indata_size = buf->len,
+        .out_format = JPEG_IMAGE_FORMAT_RGB565,
+        .out_scale = JPEG_IMAGE_SCALE_0,
+        .flags = {
+            .swap_color_bytes = LV_COLOR_16_SWAP,
+        },
+    };
+    esp_jpeg_image_output_t info;
+
+    if (esp_jpeg_get_image_info(&cfg, &info) != ESP_OK) {
+        ESP_LOGW(TAG, "Invalid JPEG thumbnail");
+        return;
+    }
+
+    // Reduce by powers of two (up to 1/8) while the image still fills the screen height
+    int scale = JPEG_IMAGE_SCALE_0;
+    while (scale < JPEG_IMAGE_SCALE_1_8 && (info.height >> (scale + 1)) >= LCD_V_RES) {
+        scale++;
+    }
+    uint32_t w = info.width >> scale;
+    uint32_t h = info.height >> scale;
+    if (w == 0 || h == 0 || w > MAX_DIMENSION || h > MAX_DIMENSION) {
+        ESP_LOGW(TAG, "Unsupported JPEG size: %ux%u", info.width, info.height);
+        return;
+    }
+
+    size_t frame_size = (size_t)w * h * sizeof(lv_color_t);
+    uint8_t *frame = frame_alloc(frame_size);
+    if (frame == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %lux%lu frame", (unsigned long)w, (unsigned long)h);
+        return;
+    }
+
+    cfg.out_scale = scale;
+    cfg.outbuf = frame;
+    cfg.outbuf_size = frame_size;
+
+    int64_t start = esp_timer_get_time();
+    if (esp_jpeg_decode(&cfg, &info) != ESP_OK) {
+        ESP_LOGW(TAG, "JPEG decode failed");
+        free(frame);
+        return;
+    }
+
+    post_frame(frame, w, h, buf->seq);
+    ESP_LOGI(TAG, "JPEG thumbnail decoded: %ux%u -> %lux%lu in %lld us", info.width, info.height,
+             (unsigned long)w, (unsigned long)h, (long long)(esp_timer_get_time() - start));
+}
+
+// Decodes the latest received image, outside the MQTT and LVGL tasks
+static void thumbnail_worker(void *arg)
+{
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        for (;;) {
+            taskENTER_CRITICAL(&s_jpeg_lock);
+            int index = s_jpeg_pending;
+            uint32_t blank_seq = s_blank_seq;
+            s_jpeg_pending = -1;
+            s_blank_seq = 0;
+            taskEXIT_CRITICAL(&s_jpeg_lock);
+
+            if (index < 0 && blank_seq == 0) {
+                break;
+            }
+            // Both may be queued; the UI keeps whichever is newer
+            if (blank_seq != 0) {
+                post_blank(blank_seq);
+            }
+            if (index >= 0) {
+                const jpeg_buf_t *buf = &s_jpeg_bufs[index];
+                if (is_png(buf->data, buf->len)) {
+                    png_decode(buf);
+                } else {
+                    jpeg_decode(buf);
+                }
+                jpeg_release(&s_jpeg_bufs[index]);
+            }
+        }
+    }
+}
+
+esp_err_t thumbnail_init(void)
+{
+    s_state = THUMB_IDLE;
+
+    if (s_png_lock == NULL) {
+        s_png_lock = xSemaphoreCreateMutex();
+        if (s_png_lock == NULL) {
+            ESP_LOGE(TAG, "Failed to create PNG mutex");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    for (int i = 0; i < JPEG_BUF_COUNT; i++) {
+        if (s_jpeg_bufs[i].data != NULL) {
+            continue;
+        }
+        s_jpeg_bufs[i].data = heap_caps_malloc(JPEG_MAX_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (s_jpeg_bufs[i].data == NULL) {
+            // Fallback to regular RAM if no PSRAM
+            s_jpeg_bufs[i].data = malloc(JPEG_MAX_SIZE);
+        }
+        if (s_jpeg_bufs[i].data == NULL) {
+            ESP_LOGW(TAG, "JPEG buffer %d not allocated", i);
+            continue;
+        }
+        taskENTER_CRITICAL(&s_jpeg_lock);
+        s_jpeg_free |= 1U << i;
+        taskEXIT_CRITICAL(&s_jpeg_lock);
+    }
+
+    if (s_worker == NULL &&
+        xTaskCreate(thumbnail_worker, "thumb", THUMB_TASK_STACK_SIZE, NULL, THUMB_TASK_PRIORITY, &s_worker) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create thumbnail task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Thumbnail stream ready");
+    return ESP_OK;
+}
+
+void thumbnail_feed(int source, const uint8_t *data, size_t len, size_t offset, size_t total_len)
+{
+    if (offset == 0) {
+        // New image: pick the path from its signature
+        jpeg_drop();
+
+        taskENTER_CRITICAL(&s_jpeg_lock);
+        bool shown = source == s_source;
+        if (shown) {
+            s_stream_seq = ++s_seq;
+        }
+        taskEXIT_CRITICAL(&s_jpeg_lock);
+
+        if (!shown) {
+            s_state = THUMB_SKIP;
+        } else if (is_png(data, len)) {
+            // No use decoding a JPEG that hasn't started yet; this newer image replaces it anyway
+            jpeg_buf_t *stale = jpeg_acquire();
+            if (stale != NULL) {
+                jpeg_release(stale);
+            }
+            s_state = THUMB_PNG;
+        } else if (len >= 2 && data[0] == 0xFF && data[1] == 0xD8) {
+            s_state = jpeg_begin(total_len) ? THUMB_JPEG : THUMB_SKIP;
+        } else {
+            ESP_LOGW(TAG, "Unknown thumbnail format");
+            s_state = THUMB_SKIP;
+        }
+        if (shown) {
+            ESP_LOGI(TAG, "Receiving thumbnail: %zu bytes", total_len);
+        }
+    }
+
+    bool last = offset + len >= total_len;
+
+    switch (s_state) {
+        case THUMB_PNG: {
+            xSemaphoreTake(s_png_lock, portMAX_DELAY);
+            // An image shown since this one started replaces it: stop writing to its frame
+            bool ok = s_stream_seq == current_seq() &&
+                      (offset != 0 || png_begin(s_stream_seq, true)) &&
+                      png_feed(data, len);
+            if (ok && last) {
+                if (!s_png_done) {
+                    ESP_LOGW(TAG, "PNG data ended early");
+                }
+                ESP_LOGI(TAG, "PNG thumbnail decoded (%zu bytes, peak %zu bytes decoder memory)",
+                         total_len, pngle_get_peak_memory(s_pngle));
+            }
+            xSemaphoreGive(s_png_lock);
+
+            if (!ok) {
+                s_state = THUMB_SKIP;
+                break;
+            }
+            ui_media_refresh_thumbnail();
+            if (last) {
+                s_state = THUMB_IDLE;
+            }
+            break;
+        }
+
+        case THUMB_JPEG:
+            if (s_stream_seq != current_seq() || s_jpeg_rx->len + len > JPEG_MAX_SIZE) {
+                if (s_stream_seq == current_seq()) {
+                    ESP_LOGW(TAG, "JPEG thumbnail overflow");
+                }
+                s_state = THUMB_SKIP;
+                break;
+            }
+            memcpy(s_jpeg_rx->data + s_jpeg_rx->len, data, len);
+            s_jpeg_rx->len += len;
+
+            if (last) {
+                // Decoded by the thumbnail task, which posts the frame to the UI
+                jpeg_submit(s_jpeg_rx);
+                s_jpeg_rx = NULL;
+                s_state = THUMB_IDLE;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    if (s_state == THUMB_SKIP) {
+        jpeg_drop();
+        if (last) {
+            s_state = THUMB_IDLE;
+        }
+    }
+}
+
+void thumbnail_show(int source, const uint8_t *data, size_t len)
+{
+    taskENTER_CRITICAL(&s_jpeg_lock);
+    s_source = source;
+    uint32_t seq = ++s_seq;
+    taskEXIT_CRITICAL(&s_jpeg_lock);
+
+    // Copied for the decode task, so the caller never waits for a decode
+    jpeg_buf_t *buf = NULL;
+    if (data != NULL && len > 0 && len <= JPEG_MAX_SIZE) {
+        buf = jpeg_acquire();
+        if (buf == NULL) {
+            ESP_LOGW(TAG, "No free image buffer, thumbnail not shown");
+        }
+    }
+
+    if (buf != NULL) {
+        memcpy(buf->data, data, len);
+        buf->len = len;
+        buf->seq = seq;
+        jpeg_submit(buf);
+    } else {
+        taskENTER_CRITICAL(&s_jpeg_lock);
+        s_blank_seq = seq;
+        taskEXIT_CRITICAL(&s_jpeg_lock);
+        xTaskNotifyGive(s_worker);
+    }
+}
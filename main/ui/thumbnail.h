@@ -0,0 +1,49 @@
+#ifndef THUMBNAIL_H
+#define THUMBNAIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * @brief Initialize the album art stream decoder
+ *
+ * PNG thumbnails are decoded with pngle while their MQTT fragments arrive, straight into an
+ * RGB565 frame that the media screen shows and refreshes as rows (or interlace passes) come in.
+ * JPEG thumbnails are received whole, then decoded into an RGB565 frame by a separate task;
+ * a newer JPEG replaces one that task hasn't started on, so only the latest image is decoded.
+ * Complete images handed to thumbnail_show() are decoded by that task as well.
+ * Frames reach the UI through ui_media_post_thumbnail(), so neither path takes the LVGL lock.
+ *
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t thumbnail_init(void);
+
+/**
+ * @brief Push one fragment of a thumbnail message
+ *
+ * Fragments must arrive in order; offset 0 starts a new image and drops any unfinished one.
+ * Images from a source other than the shown one (see thumbnail_show()) are ignored.
+ * Call from one task only (the MQTT task).
+ *
+ * @param source Id of the sender (media_players uses the player index); 0 is shown at startup
+ * @param data Fragment data (only valid during the call)
+ * @param len Length of the fragment
+ * @param offset Offset of the fragment in the message
+ * @param total_len Total length of the message
+ */
+void thumbnail_feed(int source, const uint8_t *data, size_t len, size_t offset, size_t total_len);
+
+/**
+ * @brief Show a source's images from now on, starting with a complete image already received
+ *
+ * The image is copied and decoded by the thumbnail task, so this is cheap enough for an LVGL
+ * event handler; an unfinished image of the previous source is dropped. Safe to call from any task.
+ *
+ * @param source Id of the source to show
+ * @param data Complete PNG or JPEG (only valid during the call), NULL for the screen background
+ * @param len Length of the image
+ */
+void thumbnail_show(int source, const uint8_t *data, size_t len);
+
+#endif // THUMBNAIL_H
@@ -3,15 +3,15 @@
 #include "app_config.h"
 #include "esp_log.h"
 #include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include <inttypes.h>
+#include <stdlib.h>
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/timers.h"
 #include "display/lvgl_setup.h"
-#include "esp_lv_decoder.h"  // ESP LVGL decoder for JPEG/PNG
-#include "network/mqtt_handler.h"
-#include "cJSON.h"
+#include "network/media_command.h"
+#include "network/media_players.h"
 
 static const char *TAG = "ui_media";
 
@@ -26,18 +26,46 @@ static lv_obj_t *g_play_btn = NULL;
 static lv_obj_t *g_play_label = NULL;
 static lv_obj_t *g_progress_bar = NULL;
 
-// Thumbnail image data - must persist for LVGL and shared with MQTT
-// Reduced to 20KB to fit 64x64 PNG (typically 3-8KB compressed)
-// For larger thumbnails, reduce quality or size in Home Assistant
-#define MAX_THUMBNAIL_SIZE (20 * 1024)  // 20KB max for compressed PNG
-static uint8_t *g_thumbnail_data = NULL;
-static int g_thumbnail_len = 0;
-static lv_img_dsc_t g_thumbnail_dsc;
-
-// Decoded image data (persists for LVGL to display)
-static uint8_t *g_decoded_image_data = NULL;
-
-// Media state
+// Decoded RGB565 album art. Frames are posted from other tasks into a single slot (latest wins)
+// and picked up by the LVGL task, which only swaps the image source; the frame it replaces is freed.
+#define THUMB_SWAP_PERIOD_MS 50         // How often the UI picks up a posted frame
+
+typedef struct {
+    uint8_t *pixels;
+    lv_img_dsc_t dsc;                   // One per frame, so LVGL never mixes up two images
+} thumb_frame_t;
+
+static portMUX_TYPE g_thumb_lock = portMUX_INITIALIZER_UNLOCKED;
+static thumb_frame_t g_thumb_ready;     // Posted, waiting for the UI (guarded by g_thumb_lock)
+static uint32_t g_thumb_seq = 0;        // Image number of the newest posted frame (guarded by g_thumb_lock)
+static bool g_thumb_dirty = false;      // Pixels of the shown frame changed (guarded by g_thumb_lock)
+static thumb_frame_t g_thumb_frames[2]; // Shown frame and the one replacing it (LVGL lock)
+static int g_thumb_front = -1;
+
+// Newest media state from the network. Seqlock: the sequence is odd while the (single) writer
+// copies into g_state_mailbox, so the LVGL task can tell a torn read and retry on its next tick.
+#define STATE_APPLY_PERIOD_MS LV_DISP_DEF_REFR_PERIOD
+
+static media_state_t g_state_mailbox;
+static uint32_t g_state_seq = 0;
+static uint32_t g_state_applied = 0;    // Sequence of the state shown (LVGL task)
+
+// Widgets a state change has to touch
+#define STATE_DIRTY_TITLE    (1U << 0)
+#define STATE_DIRTY_ARTIST   (1U << 1)
+#define STATE_DIRTY_PLAYING  (1U << 2)
+
+// Last state received from the player (LVGL task)
+static media_state_t g_remote_state;
+
+// Play state set locally by a button press, shown until the player confirms it or
+// OPTIMISTIC_TIMEOUT_MS pass, after which the player's own state is shown again (LVGL task)
+#define OPTIMISTIC_TIMEOUT_MS 3000
+static bool g_optimistic = false;
+static bool g_optimistic_playing = false;
+static TickType_t g_optimistic_until = 0;
+
+// Media state shown by the UI (LVGL task)
 static media_state_t g_media_state = {
     .title = "Waiting for data...",
     .artist = "Connect to MQTT",
@@ -46,18 +74,31 @@ static media_state_t g_media_state = {
     .is_playing = false
 };
 
-// Timer for progress updates
-static TimerHandle_t g_progress_timer = NULL;
+// Playback position, extrapolated on the device between state messages (LVGL task).
+// Reported positions re-anchor it; small differences to what is shown are eased out
+// rather than jumped to, so the bar doesn't stutter when a report is a little off.
+#define PROGRESS_PERIOD_MS 200
+#define PROGRESS_RANGE (LCD_H_RES - 40)     // Bar width in pixels
+#define PROGRESS_SNAP_US (3 * 1000000LL)    // Larger differences are seeks: jump
+#define PROGRESS_EASE_MIN_US 1000000LL      // Shortest time a difference is eased out over
+
+static int64_t g_pos_anchor_us = 0;         // Position at g_pos_anchor_time
+static int64_t g_pos_anchor_time = 0;       // esp_timer_get_time() of the anchor
+static int64_t g_pos_offset_us = 0;         // Shown minus reported at the anchor, fading to 0
+static int64_t g_pos_ease_us = PROGRESS_EASE_MIN_US;
+static int32_t g_progress_shown = -1;       // Bar value set last
 
 // Forward declarations
 static void play_pause_event_cb(lv_event_t *e);
 static void prev_event_cb(lv_event_t *e);
 static void next_event_cb(lv_event_t *e);
+static void player_event_cb(lv_event_t *e);
 static void update_ui(void);
 static void format_time(char *buf, uint32_t seconds);
-static void progress_timer_cb(TimerHandle_t timer);
-
-// No callback functions needed for esp_lv_decoder - it's simpler!
+static void progress_tick_cb(lv_timer_t *timer);
+static void thumbnail_swap_cb(lv_timer_t *timer);
+static void state_apply_cb(lv_timer_t *timer);
+static void apply_state(const media_state_t *state);
 
 lv_obj_t *ui_media_create(void)
 {
@@ -81,15 +122,8 @@ lv_obj_t *ui_media_create(void)
     lv_obj_set_style_bg_grad_dir(g_bg_img, LV_GRAD_DIR_VER, LV_PART_MAIN);
     lv_obj_clear_flag(g_bg_img, LV_OBJ_FLAG_SCROLLABLE);
     
-    // Allocate thumbnail buffer (for potential future use with JPEG)
-    if (g_thumbnail_data == NULL) {
-        g_thumbnail_data = heap_caps_malloc(MAX_THUMBNAIL_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-        if (g_thumbnail_data == NULL) {
-            // Fallback to regular RAM if no PSRAM
-            g_thumbnail_data = malloc(MAX_THUMBNAIL_SIZE);
-        }
-        ESP_LOGI(TAG, "Thumbnail buffer allocated: %p (display disabled)", g_thumbnail_data);
-    }
+    // Album art is decoded elsewhere (see thumbnail.c); this timer only swaps in finished frames
+    lv_timer_create(thumbnail_swap_cb, THUMB_SWAP_PERIOD_MS, NULL);
     
     // Gradient overlay (fade from left to right) - will be deleted when thumbnail arrives
     g_gradient = lv_obj_create(g_screen);
@@ -111,6 +145,9 @@ lv_obj_t *ui_media_create(void)
     lv_obj_set_style_text_color(g_title_label, COLOR_TEXT_PRIMARY, LV_PART_MAIN);
     lv_obj_set_style_text_font(g_title_label, &lv_font_montserrat_20, LV_PART_MAIN);
     lv_obj_align(g_title_label, LV_ALIGN_TOP_LEFT, 20, 30);
+    // Long press on the title shows the next media player
+    lv_obj_add_flag(g_title_label, LV_OBJ_FLAG_CLICKABLE);
+    lv_obj_add_event_cb(g_title_label, player_event_cb, LV_EVENT_LONG_PRESSED, NULL);
     
     // Artist name (below title)
     g_artist_label = lv_label_create(g_screen);
@@ -168,11 +205,16 @@ lv_obj_t *ui_media_create(void)
     
     // === PROGRESS BAR (Bottom, full width) ===
     
-    g_progress_bar = ui_create_progress_bar(g_screen, LCD_H_RES - 40);
+    g_progress_bar = ui_create_progress_bar(g_screen, PROGRESS_RANGE);
     lv_obj_align(g_progress_bar, LV_ALIGN_BOTTOM_MID, 0, -15);
     
-    // Create progress timer (1 second interval)
-    g_progress_timer = xTimerCreate("progress", pdMS_TO_TICKS(1000), pdTRUE, NULL, progress_timer_cb);
+    // Network state updates are applied from the LVGL task
+    g_remote_state = g_media_state;
+    lv_timer_create(state_apply_cb, STATE_APPLY_PERIOD_MS, NULL);
+    
+    // Moves the progress bar between state messages; one bar step per pixel
+    lv_bar_set_range(g_progress_bar, 0, PROGRESS_RANGE);
+    lv_timer_create(progress_tick_cb, PROGRESS_PERIOD_MS, NULL);
     
     ESP_LOGI(TAG, "Media player screen created");
     
@@ -183,60 +225,40 @@ static void play_pause_event_cb(lv_event_t *e)
 {
     ESP_LOGI(TAG, "Play/Pause button clicked");
 
-    // Send play or pause command based on current state
-    const char *command = g_media_state.is_playing ? "pause" : "play";
+    // Send play or pause command based on what the screen shows
+    bool play = !g_media_state.is_playing;
+    if (media_command_send(play ? MEDIA_CMD_PLAY : MEDIA_CMD_PAUSE) != ESP_OK) {
+        return;
+    }
 
-    // Create JSON payload: {"command": "play", "data": null}
-    cJSON *json = cJSON_CreateObject();
-    cJSON_AddStringToObject(json, "command", command);
-    cJSON_AddNullToObject(json, "data");
+    // Flip the icon now instead of after the round trip through Home Assistant;
+    // state_apply_cb() keeps it until the player confirms or the guess expires
+    g_optimistic_playing = play;
+    g_optimistic_until = xTaskGetTickCount() + pdMS_TO_TICKS(OPTIMISTIC_TIMEOUT_MS);
+    g_optimistic = true;
 
-    char *json_str = cJSON_PrintUnformatted(json);
-    if (json_str) {
-        mqtt_handler_publish(MQTT_TOPIC_CMD, json_str, strlen(json_str), 0, 0);
-        free(json_str);
-    }
-    cJSON_Delete(json);
+    media_state_t shown = g_media_state;
+    shown.is_playing = play;
+    apply_state(&shown);
 }
 
 static void prev_event_cb(lv_event_t *e)
 {
     ESP_LOGI(TAG, "Previous button clicked");
-
-    // Create JSON payload: {"command": "previous", "data": null}
-    cJSON *json = cJSON_CreateObject();
-    cJSON_AddStringToObject(json, "command", "previous");
-    cJSON_AddNullToObject(json, "data");
-
-    char *json_str = cJSON_PrintUnformatted(json);
-    if (json_str) {
-        mqtt_handler_publish(MQTT_TOPIC_CMD, json_str, strlen(json_str), 0, 0);
-        free(json_str);
-    }
-    cJSON_Delete(json);
+    media_command_send(MEDIA_CMD_PREVIOUS);
 }
 
 static void next_event_cb(lv_event_t *e)
 {
     ESP_LOGI(TAG, "Next button clicked");
-
-    // Create JSON payload: {"command": "next", "data": null}
-    cJSON *json = cJSON_CreateObject();
-    cJSON_AddStringToObject(json, "command", "next");
-    cJSON_AddNullToObject(json, "data");
-
-    char *json_str = cJSON_PrintUnformatted(json);
-    if (json_str) {
-        mqtt_handler_publish(MQTT_TOPIC_CMD, json_str, strlen(json_str), 0, 0);
-        free(json_str);
-    }
-    cJSON_Delete(json);
+    media_command_send(MEDIA_CMD_NEXT);
 }
 
-static void progress_timer_cb(TimerHandle_t timer)
+static void player_event_cb(lv_event_t *e)
 {
-    // Progress is now controlled by MQTT updates
-    // This timer is kept for potential future use
+    // A pending play/pause belongs to the player being left
+    g_optimistic = false;
+    media_players_select_next();
 }
 
 static void update_ui(void)
@@ -258,194 +280,330 @@ static void format_time(char *buf, uint32_t seconds)
 
 void ui_media_update_state(const media_state_t *state)
 {
-    // Safety check - make sure UI is initialized
-    if (g_title_label == NULL || g_artist_label == NULL || g_play_label == NULL || g_progress_bar == NULL) {
-        ESP_LOGW(TAG, "UI not initialized yet, skipping update");
+    if (state == NULL) {
         return;
     }
-    
-    if (state) {
-        // Copy state
-        strncpy(g_media_state.title, state->title, sizeof(g_media_state.title) - 1);
-        strncpy(g_media_state.artist, state->artist, sizeof(g_media_state.artist) - 1);
-        g_media_state.duration_sec = state->duration_sec;
-        g_media_state.position_sec = state->position_sec;
-        g_media_state.is_playing = state->is_playing;
-
-        // Truncate title if too long (max 25 chars, truncate to 22 + "...")
-        size_t title_len = strlen(g_media_state.title);
-        if (title_len > 25) {
-            g_media_state.title[22] = '.';
-            g_media_state.title[23] = '.';
-            g_media_state.title[24] = '.';
-            g_media_state.title[25] = '\0';
+
+    uint32_t seq = __atomic_load_n(&g_state_seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_state_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&g_state_mailbox, state, sizeof(g_state_mailbox));
+    __atomic_store_n(&g_state_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+// Copies the newest published state; false if there is nothing new or it is being written
+static bool read_state_mailbox(media_state_t *state)
+{
+    uint32_t seq = __atomic_load_n(&g_state_seq, __ATOMIC_ACQUIRE);
+    if (seq == g_state_applied || (seq & 1) != 0) {
+        return false;
+    }
+
+    memcpy(state, &g_state_mailbox, sizeof(*state));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&g_state_seq, __ATOMIC_RELAXED) != seq) {
+        return false;  // Overwritten while copying
+    }
+
+    g_state_applied = seq;
+    return true;
+}
+
+// Position shown at time now
+static int64_t playback_position_us(int64_t now)
+{
+    int64_t elapsed = now - g_pos_anchor_time;
+    int64_t pos = g_pos_anchor_us;
+
+    if (g_media_state.is_playing) {
+        pos += elapsed;
+    }
+    if (g_pos_offset_us != 0 && elapsed < g_pos_ease_us) {
+        pos += g_pos_offset_us * (g_pos_ease_us - elapsed) / g_pos_ease_us;
+    }
+
+    int64_t duration = (int64_t)g_media_state.duration_sec * 1000000;
+    if (duration > 0 && pos > duration) {
+        pos = duration;
+    }
+    return pos < 0 ? 0 : pos;
+}
+
+// Re-anchors at the position shown now, e.g. before the play state changes
+static void playback_rebase(int64_t now)
+{
+    g_pos_anchor_us = playback_position_us(now);
+    g_pos_anchor_time = now;
+    g_pos_offset_us = 0;
+}
+
+// Takes the position a state message reported
+static void playback_sync(const media_state_t *state, bool new_track, int64_t now)
+{
+    // Whole seconds, truncated: while playing, the player is half a second further on average
+    int64_t reported = (int64_t)state->position_sec * 1000000 + (state->is_playing ? 500000 : 0);
+    int64_t error = playback_position_us(now) - reported;
+
+    g_pos_anchor_us = reported;
+    g_pos_anchor_time = now;
+    g_pos_offset_us = 0;
+
+    if (!new_track && state->is_playing == g_media_state.is_playing && llabs(error) < PROGRESS_SNAP_US) {
+        // Drift: keep showing the current position and fade the difference out. Twice as
+        // long as the error itself, so the bar never runs backwards while playing.
+        g_pos_offset_us = error;
+        g_pos_ease_us = llabs(error) * 2;
+        if (g_pos_ease_us < PROGRESS_EASE_MIN_US) {
+            g_pos_ease_us = PROGRESS_EASE_MIN_US;
         }
+    }
+}
+
+// Sets the progress bar if the position moved by at least a pixel; stays put while the duration is unknown
+static void update_progress(int64_t now)
+{
+    if (g_media_state.duration_sec == 0) {
+        return;
+    }
+
+    int64_t duration = (int64_t)g_media_state.duration_sec * 1000000;
+    int32_t value = (int32_t)(playback_position_us(now) * PROGRESS_RANGE / duration);
+    if (value != g_progress_shown) {
+        g_progress_shown = value;
+        lv_bar_set_value(g_progress_bar, value, LV_ANIM_OFF);
+    }
+}
+
+// Runs in the LVGL task: advances the progress bar between state messages
+static void progress_tick_cb(lv_timer_t *timer)
+{
+    update_progress(esp_timer_get_time());
+}
+
+// Shows state, touching only the widgets whose part of it changed (LVGL task)
+static void apply_state(const media_state_t *state)
+{
+    media_state_t snapshot = *state;
 
-        // Update UI elements
+    snapshot.title[sizeof(snapshot.title) - 1] = '\0';
+    snapshot.artist[sizeof(snapshot.artist) - 1] = '\0';
+
+    // Truncate title if too long (max 25 chars, truncate to 22 + "...")
+    if (strlen(snapshot.title) > 25) {
+        snapshot.title[22] = '.';
+        snapshot.title[23] = '.';
+        snapshot.title[24] = '.';
+        snapshot.title[25] = '\0';
+    }
+
+    // Most messages during playback only move the position; leave unchanged widgets alone
+    // so they are neither laid out nor redrawn (and flushed over SPI) again
+    uint32_t dirty = 0;
+    if (strcmp(snapshot.title, g_media_state.title) != 0) {
+        dirty |= STATE_DIRTY_TITLE;
+    }
+    if (strcmp(snapshot.artist, g_media_state.artist) != 0) {
+        dirty |= STATE_DIRTY_ARTIST;
+    }
+    if (snapshot.is_playing != g_media_state.is_playing) {
+        dirty |= STATE_DIRTY_PLAYING;
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (dirty & STATE_DIRTY_PLAYING) {
+        playback_rebase(now);  // Stop or start counting from where the bar is
+    }
+    g_media_state = snapshot;
+
+    if (dirty & STATE_DIRTY_TITLE) {
         lv_label_set_text(g_title_label, g_media_state.title);
+    }
+    if (dirty & STATE_DIRTY_ARTIST) {
         lv_label_set_text(g_artist_label, g_media_state.artist);
-        
-        // Update play/pause icon
-        if (g_media_state.is_playing) {
-            lv_label_set_text(g_play_label, LV_SYMBOL_PAUSE);
-        } else {
-            lv_label_set_text(g_play_label, LV_SYMBOL_PLAY);
-        }
-        
-        // Update progress bar
-        if (g_media_state.duration_sec > 0) {
-            uint32_t progress = (g_media_state.position_sec * 100) / g_media_state.duration_sec;
-            lv_bar_set_value(g_progress_bar, progress, LV_ANIM_OFF);
-        }
-        
-        ESP_LOGI(TAG, "UI updated: %s - %s [%s]", 
+    }
+
+    // Update play/pause icon
+    if (dirty & STATE_DIRTY_PLAYING) {
+        lv_label_set_text_static(g_play_label, g_media_state.is_playing ? LV_SYMBOL_PAUSE : LV_SYMBOL_PLAY);
+    }
+
+    // The position itself is extrapolated, see playback_position_us()
+    update_progress(now);
+
+    if (dirty) {
+        ESP_LOGI(TAG, "UI updated: %s - %s [%s]",
                  g_media_state.title, g_media_state.artist,
                  g_media_state.is_playing ? "playing" : "paused");
     }
 }
 
-uint8_t *ui_media_get_thumbnail_buffer(size_t *size)
+// Runs in the LVGL task: applies the newest state, if any, over an unconfirmed local change
+static void state_apply_cb(lv_timer_t *timer)
 {
-    if (size != NULL) {
-        *size = MAX_THUMBNAIL_SIZE;
+    media_state_t received;
+    bool fresh = read_state_mailbox(&received);
+    bool changed = fresh;
+    bool new_track = false;
+    if (fresh) {
+        new_track = strcmp(received.title, g_remote_state.title) != 0 ||
+                    strcmp(received.artist, g_remote_state.artist) != 0;
+        g_remote_state = received;
     }
-    return g_thumbnail_data;
-}
 
-void ui_media_update_thumbnail(const uint8_t *data, int data_len)
-{
-    if (data == NULL || data_len <= 0) {
-        ESP_LOGW(TAG, "Invalid thumbnail data");
+    if (g_optimistic) {
+        if (changed && g_remote_state.is_playing == g_optimistic_playing) {
+            g_optimistic = false;  // Confirmed
+        } else if ((int32_t)(xTaskGetTickCount() - g_optimistic_until) >= 0) {
+            ESP_LOGW(TAG, "Player did not follow play/pause, showing its state");
+            g_optimistic = false;
+            changed = true;
+        }
+    }
+    if (!changed) {
         return;
     }
 
-    if (g_thumbnail_data == NULL) {
-        ESP_LOGE(TAG, "Thumbnail buffer not allocated");
-        return;
+    // Messages sent before the player acted on the command still carry the old play state
+    media_state_t shown = g_remote_state;
+    if (g_optimistic) {
+        shown.is_playing = g_optimistic_playing;
+    }
+    if (fresh) {
+        playback_sync(&shown, new_track, esp_timer_get_time());
     }
+    apply_state(&shown);
+}
 
-    if (data_len > MAX_THUMBNAIL_SIZE) {
-        ESP_LOGW(TAG, "Thumbnail too large: %d bytes (max %d)", data_len, MAX_THUMBNAIL_SIZE);
-        return;
+void ui_media_post_thumbnail(uint8_t *pixels, uint16_t w, uint16_t h, uint32_t seq)
+{
+    uint8_t *dropped = NULL;
+
+    taskENTER_CRITICAL(&g_thumb_lock);
+    if ((int32_t)(seq - g_thumb_seq) < 0) {
+        // Finished after a newer image was posted
+        dropped = pixels;
+    } else {
+        // Not shown yet: the newer frame replaces it
+        dropped = g_thumb_ready.pixels;
+        g_thumb_ready.pixels = pixels;
+        g_thumb_ready.dsc.header.always_zero = 0;
+        g_thumb_ready.dsc.header.cf = LV_IMG_CF_TRUE_COLOR;
+        g_thumb_ready.dsc.header.w = w;
+        g_thumb_ready.dsc.header.h = h;
+        g_thumb_ready.dsc.data_size = (uint32_t)w * h * sizeof(lv_color_t);
+        g_thumb_ready.dsc.data = pixels;
+        g_thumb_seq = seq;
     }
+    taskEXIT_CRITICAL(&g_thumb_lock);
 
-    // Check available heap
-    size_t free_heap = esp_get_free_heap_size();
-    ESP_LOGI(TAG, "Updating thumbnail: %d bytes (free heap: %" PRIu32 ")",
-             data_len, (uint32_t)free_heap);
+    free(dropped);
+}
 
-    // Detect image format
-    if (data_len >= 4) {
-        ESP_LOGI(TAG, "Thumbnail header: %02X %02X %02X %02X",
-                 data[0], data[1], data[2], data[3]);
+void ui_media_refresh_thumbnail(void)
+{
+    taskENTER_CRITICAL(&g_thumb_lock);
+    g_thumb_dirty = true;
+    taskEXIT_CRITICAL(&g_thumb_lock);
+}
 
-        if (data[0] == 0xFF && data[1] == 0xD8) {
-            ESP_LOGI(TAG, "Detected JPEG format");
-        } else if (data[0] == 0x89 && data[1] == 0x50 && data[2] == 0x4E && data[3] == 0x47) {
-            ESP_LOGI(TAG, "Detected PNG format");
-        } else {
-            ESP_LOGW(TAG, "Unknown image format");
-            return;
-        }
+// Turns the placeholder background into the album art widget; call with the LVGL lock held
+static bool create_thumbnail_widget(void)
+{
+    // Delete the gradient overlay on first thumbnail
+    if (g_gradient != NULL) {
+        lv_obj_del(g_gradient);
+        g_gradient = NULL;
+        ESP_LOGI(TAG, "Removed gradient overlay");
     }
 
-    // CRITICAL: Copy JPEG data to persistent buffer!
-    // The 'data' pointer from MQTT will be freed after this function returns
-    memcpy(g_thumbnail_data, data, data_len);
-    g_thumbnail_len = data_len;
+    // Replace the placeholder background
+    if (g_bg_img != NULL) {
+        lv_obj_del(g_bg_img);
+        g_bg_img = NULL;
+    }
 
-    if (lvgl_lock(1000)) {
-        // Delete the gradient overlay on first thumbnail
-        if (g_gradient != NULL) {
-            lv_obj_del(g_gradient);
-            g_gradient = NULL;
-            ESP_LOGI(TAG, "Removed gradient overlay");
-        }
+    g_bg_img = lv_img_create(g_screen);
+    if (g_bg_img == NULL) {
+        ESP_LOGE(TAG, "Failed to create image object");
+        return false;
+    }
 
-        // Clean up old image widget
-        if (g_bg_img != NULL) {
-            lv_obj_del(g_bg_img);
-            g_bg_img = NULL;
-        }
+    lv_obj_clear_flag(g_bg_img, LV_OBJ_FLAG_SCROLLABLE);
 
-        // Free old decoded image data from decoder
-        if (g_decoded_image_data != NULL) {
-            free(g_decoded_image_data);
-            g_decoded_image_data = NULL;
-            ESP_LOGI(TAG, "Freed old decoded image data");
-        }
+    // Use real size mode (no tiling)
+    lv_img_set_size_mode(g_bg_img, LV_IMG_SIZE_MODE_REAL);
 
-        // Create new image widget
-        g_bg_img = lv_img_create(g_screen);
-        if (g_bg_img == NULL) {
-            ESP_LOGE(TAG, "Failed to create image object");
-            lvgl_unlock();
-            return;
-        }
+    // Full opacity for album art (no transparency)
+    lv_obj_set_style_img_opa(g_bg_img, LV_OPA_COVER, LV_PART_MAIN);
 
-        // Setup LVGL image descriptor pointing to PERSISTENT buffer
-        g_thumbnail_dsc.header.always_zero = 0;
-        g_thumbnail_dsc.header.cf = LV_IMG_CF_RAW;  // Raw compressed data (JPEG/PNG)
-        g_thumbnail_dsc.header.w = 0;  // Will be determined by decoder
-        g_thumbnail_dsc.header.h = 0;
-        g_thumbnail_dsc.data_size = g_thumbnail_len;
-        g_thumbnail_dsc.data = g_thumbnail_data;  // Points to persistent buffer!
-
-        // Set the image source - LVGL will decode it automatically!
-        lv_img_set_src(g_bg_img, &g_thumbnail_dsc);
-
-        // Get the actual decoded image dimensions
-        lv_img_header_t img_header;
-        lv_res_t res = lv_img_decoder_get_info(&g_thumbnail_dsc, &img_header);
-
-        if (res == LV_RES_OK && img_header.h > 0) {
-            // Calculate zoom to fill 170px height (256 = 1x zoom in LVGL)
-            uint16_t zoom_factor = (LCD_V_RES * 256) / img_header.h;
-            lv_img_set_zoom(g_bg_img, zoom_factor);
-            ESP_LOGI(TAG, "Image: %dx%d, zoom: %d (fill height to %d)",
-                     img_header.w, img_header.h, zoom_factor, LCD_V_RES);
-        } else {
-            // Fallback: no zoom
-            lv_img_set_zoom(g_bg_img, 256);
-        }
+    // Move to background (behind text/controls)
+    lv_obj_move_background(g_bg_img);
 
-        // Position on the right side - will align right edge
-        lv_obj_align(g_bg_img, LV_ALIGN_RIGHT_MID, 0, 0);
-        lv_obj_clear_flag(g_bg_img, LV_OBJ_FLAG_SCROLLABLE);
+    // Gradient overlay between image and text, created once
+    if (g_img_gradient == NULL) {
+        g_img_gradient = lv_obj_create(g_screen);
+        lv_obj_set_size(g_img_gradient, LCD_H_RES, LCD_V_RES);
+        lv_obj_set_style_bg_opa(g_img_gradient, LV_OPA_TRANSP, LV_PART_MAIN);  // Transparent background
+        lv_obj_set_style_bg_grad_dir(g_img_gradient, LV_GRAD_DIR_HOR, LV_PART_MAIN);
+        lv_obj_set_style_bg_color(g_img_gradient, COLOR_BG_PRIMARY, LV_PART_MAIN);  // Solid on left
+        lv_obj_set_style_bg_grad_color(g_img_gradient, lv_color_hex(0x000000), LV_PART_MAIN);  // Fade to transparent on right
+        lv_obj_set_style_bg_grad_stop(g_img_gradient, 180, LV_PART_MAIN);  // Gradient starts at ~70%
+        lv_obj_set_style_border_width(g_img_gradient, 0, LV_PART_MAIN);
+        lv_obj_set_style_pad_all(g_img_gradient, 0, LV_PART_MAIN);
+        lv_obj_align(g_img_gradient, LV_ALIGN_CENTER, 0, 0);
 
-        // Use real size mode (no tiling)
-        lv_img_set_size_mode(g_bg_img, LV_IMG_SIZE_MODE_REAL);
+        // Position it between image and text (above image, below UI controls)
+        lv_obj_move_to_index(g_img_gradient, 1);
 
-        // Full opacity for album art (no transparency)
-        lv_obj_set_style_img_opa(g_bg_img, LV_OPA_COVER, LV_PART_MAIN);
+        ESP_LOGI(TAG, "Created gradient overlay");
+    }
 
-        // Move to background (behind text/controls)
-        lv_obj_move_background(g_bg_img);
+    return true;
+}
 
-        // Create gradient overlay ONLY ONCE (not every time!)
-        if (g_img_gradient == NULL) {
-            g_img_gradient = lv_obj_create(g_screen);
-            lv_obj_set_size(g_img_gradient, LCD_H_RES, LCD_V_RES);
-            lv_obj_set_style_bg_opa(g_img_gradient, LV_OPA_TRANSP, LV_PART_MAIN);  // Transparent background
-            lv_obj_set_style_bg_grad_dir(g_img_gradient, LV_GRAD_DIR_HOR, LV_PART_MAIN);
-            lv_obj_set_style_bg_color(g_img_gradient, COLOR_BG_PRIMARY, LV_PART_MAIN);  // Solid on left
-            lv_obj_set_style_bg_grad_color(g_img_gradient, lv_color_hex(0x000000), LV_PART_MAIN);  // Fade to transparent on right
-            lv_obj_set_style_bg_grad_stop(g_img_gradient, 180, LV_PART_MAIN);  // Gradient starts at ~70%
-            lv_obj_set_style_border_width(g_img_gradient, 0, LV_PART_MAIN);
-            lv_obj_set_style_pad_all(g_img_gradient, 0, LV_PART_MAIN);
-            lv_obj_align(g_img_gradient, LV_ALIGN_CENTER, 0, 0);
+// Runs in the LVGL task: swaps in the latest posted frame, if any
+static void thumbnail_swap_cb(lv_timer_t *timer)
+{
+    int back = g_thumb_front == 0 ? 1 : 0;
+
+    taskENTER_CRITICAL(&g_thumb_lock);
+    bool dirty = g_thumb_dirty;
+    g_thumb_dirty = false;
+    g_thumb_frames[back] = g_thumb_ready;
+    g_thumb_ready.pixels = NULL;
+    taskEXIT_CRITICAL(&g_thumb_lock);
+
+    thumb_frame_t *frame = &g_thumb_frames[back];
+    if (frame->pixels == NULL) {
+        if (dirty && g_thumb_front >= 0) {
+            lv_obj_invalidate(g_bg_img);
+        }
+        return;
+    }
 
-            // Position it between image and text (above image, below UI controls)
-            lv_obj_move_to_index(g_img_gradient, 1);
+    if (g_thumb_front < 0 && !create_thumbnail_widget()) {
+        free(frame->pixels);
+        frame->pixels = NULL;
+        return;
+    }
 
-            ESP_LOGI(TAG, "Created gradient overlay");
-        }
+    lv_img_set_src(g_bg_img, &frame->dsc);
 
-        lvgl_unlock();
-        ESP_LOGI(TAG, "Thumbnail displayed");
-    } else {
-        ESP_LOGW(TAG, "Failed to acquire LVGL lock");
+    // Zoom to fill 170px height (256 = 1x zoom in LVGL)
+    uint16_t zoom_factor = (LCD_V_RES * 256) / frame->dsc.header.h;
+    lv_img_set_zoom(g_bg_img, zoom_factor);
+
+    // Position on the right side - will align right edge
+    lv_obj_align(g_bg_img, LV_ALIGN_RIGHT_MID, 0, 0);
+
+    // LVGL no longer reads the frame it showed before
+    if (g_thumb_front >= 0) {
+        lv_img_cache_invalidate_src(&g_thumb_frames[g_thumb_front].dsc);
+        free(g_thumb_frames[g_thumb_front].pixels);
+        g_thumb_frames[g_thumb_front].pixels = NULL;
     }
+    g_thumb_front = back;
 
-    ESP_LOGI(TAG, "Free heap after decode: %" PRIu32 " bytes", (uint32_t)esp_get_free_heap_size());
+    ESP_LOGI(TAG, "Thumbnail displayed: %dx%d, zoom: %d (free heap: %" PRIu32 ")",
+             frame->dsc.header.w, frame->dsc.header.h, zoom_factor, (uint32_t)esp_get_free_heap_size());
 }
@@ -4,15 +4,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include "lvgl.h"
-
-// Media state structure
-typedef struct {
-    char title[128];
-    char artist[128];
-    uint32_t duration_sec;  // Total duration in seconds
-    uint32_t position_sec;  // Current position in seconds
-    bool is_playing;
-} media_state_t;
+#include "media_state.h"
 
 /**
  * @brief Create and return the media player screen
@@ -22,27 +14,36 @@ typedef struct {
 lv_obj_t *ui_media_create(void);
 
 /**
- * @brief Update media state (for future backend integration)
- * 
+ * @brief Publish a new media state to the UI
+ *
+ * Copies the state into a single-slot mailbox and returns without touching LVGL; the
+ * LVGL task applies the newest state once per display refresh period, so a burst of
+ * messages costs one UI update. Calls must not overlap (media_players serializes them).
+ *
  * @param state New media state
  */
 void ui_media_update_state(const media_state_t *state);
 
 /**
- * @brief Update album art thumbnail from JPEG data
- * 
- * @param data JPEG image data
- * @param data_len Length of image data
+ * @brief Hand a decoded album art frame over to the UI
+ *
+ * Returns right away without touching LVGL; the LVGL task swaps the frame in within 50 ms.
+ * A frame the UI has not picked up yet is dropped in favor of a newer one, and a frame
+ * older than the last one posted is dropped right away. Safe to call from any task.
+ *
+ * @param pixels w x h lv_color_t pixels from malloc(); the UI frees them once replaced.
+ *               They may still be written until a newer image is posted, see ui_media_refresh_thumbnail()
+ * @param w Width in pixels
+ * @param h Height in pixels
+ * @param seq Number of the image, increasing (with wrap-around) in the order the images arrived
  */
-void ui_media_update_thumbnail(const uint8_t *data, int data_len);
+void ui_media_post_thumbnail(uint8_t *pixels, uint16_t w, uint16_t h, uint32_t seq);
 
 /**
- * @brief Get the thumbnail buffer pointer and size for MQTT to use
- * This avoids duplicate buffer allocation
- * 
- * @param size Output parameter for buffer size
- * @return uint8_t* Pointer to thumbnail buffer
+ * @brief Redraw the album art after its pixels changed in place
+ *
+ * Only sets a flag for the LVGL task; safe to call from any task.
  */
-uint8_t *ui_media_get_thumbnail_buffer(size_t *size);
+void ui_media_refresh_thumbnail(void);
 
 #endif // UI_MEDIA_H